@@ -49,6 +49,7 @@
 #define ecs_eis_is_alive(world, entity) flecs_sparse_is_alive(ecs_eis(world), entity)
 #define ecs_eis_get_current(world, entity) flecs_sparse_get_alive(ecs_eis(world), entity)
 #define ecs_eis_exists(world, entity) flecs_sparse_exists(ecs_eis(world), entity)
+#define ecs_eis_prefetch(world, entity) flecs_sparse_prefetch(ecs_eis(world), entity)
 #define ecs_eis_recycle(world) flecs_sparse_new_id(ecs_eis(world))
 #define ecs_eis_clear_entity(world, entity, is_watched) ecs_eis_set(ecs_eis(world), entity, &(ecs_record_t){NULL, is_watched})
 #define ecs_eis_set_size(world, size) flecs_sparse_set_size(ecs_eis(world), size)
@@ -243,9 +244,9 @@ void flecs_switch_addn(
     ecs_switch_t *sw,
     int32_t count);    
 
-/** Set value of element. */
+/** Set value of element. Returns true if no other element has the value. */
 FLECS_DBG_API
-void flecs_switch_set(
+bool flecs_switch_set(
     ecs_switch_t *sw,
     int32_t element,
     uint64_t value);
@@ -453,7 +454,9 @@ struct ecs_table_t {
     ecs_data_t data;                 /* Component storage */
     ecs_type_info_t **type_info;     /* Cached type info */
 
-    int32_t *dirty_state;            /* Keep track of changes in columns */
+    int32_t *dirty_state;            /* Keep track of changes in columns,
+                                      * followed by the union columns */
+    int32_t dirty_frame;             /* Last frame in which dirty_state changed */
 
     int16_t sw_count;
     int16_t sw_offset;
@@ -461,6 +464,7 @@ struct ecs_table_t {
     int16_t bs_offset;
 
     int32_t refcount;                /* Increased when used as storage table */
+    int32_t reserved;                /* Storage capacity table won't shrink below */
     int16_t lock;                    /* Prevents modifications */
     uint16_t record_count;           /* Table record count including wildcards */
 };
@@ -492,6 +496,8 @@ typedef struct flecs_switch_term_t {
     ecs_switch_t *sw_column;
     ecs_entity_t sw_case; 
     int32_t signature_column_index;
+    int32_t sw_index;       /* Index of switch column in table */
+    bool sw_not;            /* Match entities that don't have sw_case */
 } flecs_switch_term_t;
 
 /* Bitset query column */
@@ -534,6 +540,8 @@ struct ecs_query_table_match_t {
     ecs_query_table_match_t *next_match;
 
     int32_t *monitor;                /* Used to monitor table for changes */
+    bool sort_dirty;                 /* Rows need to be merged into slices */
+    int32_t sort_helper;             /* Used while building sorted slices */
 };
 
 /** A single table can occur multiple times in the cache when a term matches
@@ -635,6 +643,14 @@ typedef struct ecs_event_id_record_t {
 /** All triggers for a specific event */
 typedef struct ecs_event_record_t {
     ecs_map_t event_ids;     /* map<id, ecs_event_id_record_t> */
+
+    /* Number of ids with triggers per kind of wildcard. Used to skip lookups
+     * for wildcard ids that have no triggers when emitting events. */
+    int32_t wildcard_count;     /* *, _ */
+    int32_t rel_wildcard_count; /* (R, *) */
+    int32_t obj_wildcard_count; /* (*, O), (*, *) */
+
+    int32_t set_count;          /* SuperSet/SubSet triggers */
 } ecs_event_record_t;
 
 /** Types for deferred operations */
@@ -817,6 +833,8 @@ struct ecs_world_t {
 
     ecs_hashmap_t aliases;
     ecs_hashmap_t symbols;
+    ecs_hashmap_t path_cache;    /* Cache with results of path lookups */
+    int32_t path_cache_count;    /* Number of entries in path cache */
     const char *name_prefix;     /* Remove prefix from C names in modules */
 
 
@@ -847,6 +865,14 @@ struct ecs_world_t {
     ecs_world_info_t info;
 
 
+    /* -- Empty table cleanup -- */
+
+    uint16_t gc_clear_generation;  /* Free table data after N empty frames */
+    uint16_t gc_delete_generation; /* Delete table after N empty frames */
+    double gc_time_budget;         /* Max time spent on cleanup per frame */
+    int32_t gc_cursor;             /* Dense index of next table to visit */
+
+
     /* -- World lock -- */
 
     ecs_os_mutex_t mutex;        /* Locks the world if locking enabled */
@@ -980,6 +1006,9 @@ struct ecs_id_record_t {
     /* Cached pointer to type info for id, if id contains data. */
     const ecs_type_info_t *type_info;
 
+    /* Number of rows to reserve in tables with the id (see ecs_reserve_id) */
+    int32_t reserve;
+
     /* Id of record */
     ecs_id_t id;
 
@@ -1103,11 +1132,22 @@ void flecs_set_triggers_notify(
     ecs_entity_t event,
     ecs_id_t set_id);
 
+/* Are there SuperSet/SubSet triggers for the event */
+bool flecs_set_triggers_exist(
+    ecs_observable_t *observable,
+    ecs_entity_t event);
+
 bool flecs_check_triggers_for_event(
     const ecs_poly_t *world,
     ecs_id_t id,
     ecs_entity_t event);
 
+/* Get EcsIdHas* flags for the events that have triggers matching the id,
+ * including triggers for wildcards that match the id */
+ecs_flags32_t flecs_id_observed_flags(
+    const ecs_world_t *world,
+    ecs_id_t id);
+
 void flecs_trigger_fini(
     ecs_world_t *world,
     ecs_trigger_t *trigger);
@@ -1725,6 +1765,10 @@ void flecs_delete_table(
 void flecs_process_pending_tables(
     const ecs_world_t *world);
 
+/* Incrementally collect empty tables, as configured by ecs_set_empty_table_gc */
+void flecs_collect_empty_tables(
+    ecs_world_t *world);
+
 /* Suspend/resume readonly state. To fully support implicit registration of
  * components, it should be possible to register components while the world is
  * in readonly mode. It is not uncommon that a component is used first from
@@ -2044,6 +2088,17 @@ void flecs_bootstrap(
 /* Bootstrap functions for other parts in the code */
 void flecs_bootstrap_hierarchy(ecs_world_t *world);
 
+/* Cache with results of path lookups, see ecs_lookup_path_w_sep */
+void flecs_path_cache_init(
+    ecs_world_t *world);
+
+void flecs_path_cache_fini(
+    ecs_world_t *world);
+
+/* Invalidate path cache when an entity is renamed, reparented or deleted */
+void flecs_path_cache_clear(
+    ecs_world_t *world);
+
 
 ////////////////////////////////////////////////////////////////////////////////
 //// Entity API
@@ -2191,6 +2246,13 @@ uint64_t flecs_hash(
     const void *data,
     ecs_size_t length);
 
+#ifdef FLECS_HASH_CUSTOM
+/* Provided by the application when built with FLECS_HASH_CUSTOM */
+uint64_t flecs_hash_custom(
+    const void *data,
+    ecs_size_t length);
+#endif
+
 /* Get next power of 2 */
 int32_t flecs_next_pow_of_2(
     int32_t n);
@@ -2840,6 +2902,11 @@ void flecs_table_init(
 
         /* Initialize event flags */
         table->flags |= idr->flags & EcsIdEventMask;
+
+        /* Inherit the largest storage reservation of the table's ids */
+        if (idr->reserve > table->reserved) {
+            table->reserved = idr->reserve;
+        }
     }
 
     world->store.records = records;
@@ -3355,9 +3422,9 @@ void mark_table_dirty(
     ecs_table_t *table,
     int32_t index)
 {
-    (void)world;
     if (table->dirty_state) {
         table->dirty_state[index] ++;
+        table->dirty_frame = world->info.frame_count_total;
     }
 }
 
@@ -3373,6 +3440,7 @@ void flecs_table_mark_dirty(
         int32_t index = ecs_search(world, table->storage_table, component, 0);
         ecs_assert(index != -1, ECS_INTERNAL_ERROR, NULL);
         table->dirty_state[index + 1] ++;
+        table->dirty_frame = world->info.frame_count_total;
     }
 }
 
@@ -3563,6 +3631,11 @@ void* grow_column(
             ecs_storage_set_size(column, size, dst_size);
         }
 
+        /* Nothing to add when only reserving storage */
+        if (!to_add) {
+            return NULL;
+        }
+
         result = ecs_storage_grow(column, size, to_add);
 
         ecs_xtor_t ctor;
@@ -3597,6 +3670,7 @@ int32_t grow_data(
     ecs_column_t *columns = data->columns;
     ecs_switch_t *sw_columns = data->sw_columns;
     ecs_bitset_t *bs_columns = data->bs_columns; 
+    int32_t cur_size = data->entities.size;
 
     /* Add record to record ptr array */
     ecs_storage_set_size_t(&data->records, ecs_record_t*, size);
@@ -3611,6 +3685,7 @@ int32_t grow_data(
     ecs_entity_t *e = ecs_storage_last_t(&data->entities, ecs_entity_t) + 1;
     data->entities.count += to_add;
     ecs_assert(data->entities.size == size, ECS_INTERNAL_ERROR, NULL);
+    world->info.table_realloc_total += cur_size && (cur_size != size);
 
     /* Initialize entity ids and record ptrs */
     int32_t i;
@@ -3638,10 +3713,15 @@ int32_t grow_data(
         flecs_switch_addn(sw, to_add);
     }
 
-    /* Add elements to each bitset column */
+    /* Add elements to each bitset column. Components start out enabled. */
     for (i = 0; i < bs_count; i ++) {
         ecs_bitset_t *bs = &bs_columns[i];
         flecs_bitset_addn(bs, to_add);
+
+        int32_t row;
+        for (row = cur_count; row < cur_count + to_add; row ++) {
+            flecs_bitset_set(bs, row, true);
+        }
     }
 
     /* If the table is monitored indicate that there has been a change */
@@ -3688,6 +3768,16 @@ int32_t flecs_table_append(
     int32_t count = data->entities.count;
     int32_t column_count = table->storage_count;
     ecs_column_t *columns = table->data.columns;
+
+    /* If the arrays will realloc and the table has a reservation that isn't
+     * met yet, grow straight to the reservation instead of doubling. */
+    if (count == data->entities.size) {
+        if (count < table->reserved) {
+            flecs_table_set_size(world, table, data, table->reserved);
+        } else {
+            world->info.table_realloc_total += count != 0;
+        }
+    }
     
     /* Grow buffer with entity ids, set new element to new entity */
     ecs_entity_t *e = ecs_storage_append_t(&data->entities, ecs_entity_t);
@@ -3751,12 +3841,13 @@ int32_t flecs_table_append(
         flecs_switch_add(sw);
     }
 
-    /* Add element to each bitset column */
+    /* Add element to each bitset column. Components start out enabled. */
     for (i = 0; i < bs_count; i ++) {
         ecs_assert(bs_columns != NULL, ECS_INTERNAL_ERROR, NULL);
         ecs_bitset_t *bs = &bs_columns[i];
         flecs_bitset_addn(bs, 1);
-    }    
+        flecs_bitset_set(bs, count, true);
+    }
 
     /* If this is the first entity in this table, signal queries so that the
      * table moves from an inactive table to an active table. */
@@ -4085,8 +4176,18 @@ int32_t flecs_table_appendn(
     check_table_sanity(table);
 
     int32_t cur_count = flecs_table_data_count(data);
+    int32_t size = cur_count + to_add;
+
+    /* Grow straight to the reservation, and don't shrink existing storage */
+    if (size < table->reserved) {
+        size = table->reserved;
+    }
+    if (size < data->entities.size) {
+        size = data->entities.size;
+    }
+
     int32_t result = grow_data(
-        world, table, data, to_add, cur_count + to_add, ids);
+        world, table, data, to_add, size, ids);
     check_table_sanity(table);
     return result;
 }
@@ -4102,38 +4203,88 @@ void flecs_table_set_size(
 
     check_table_sanity(table);
 
-    int32_t cur_count = flecs_table_data_count(data);
-
-    if (cur_count < size) {
+    if (data->entities.size < size) {
         grow_data(world, table, data, 0, size, NULL);
         check_table_sanity(table);
     }
 }
 
+static
+void shrink_column(
+    ecs_column_t *column,
+    ecs_type_info_t *ti,
+    ecs_size_t size,
+    int32_t elem_count)
+{
+    if (!elem_count) {
+        ecs_storage_fini(column);
+        return;
+    }
+
+    /* If the component has a move action, move elements manually */
+    ecs_move_t move_ctor;
+    int32_t count = column->count;
+    if (count && ti && (move_ctor = ti->lifecycle.move_ctor)) {
+        ecs_column_t dst;
+        ecs_storage_init(&dst, size, elem_count);
+        dst.count = count;
+        move_ctor(dst.array, column->array, count, ti);
+        ecs_storage_fini(column);
+        *column = dst;
+    } else {
+        ecs_storage_set_size(column, size, elem_count);
+    }
+}
+
 bool flecs_table_shrink(
     ecs_world_t *world,
     ecs_table_t *table)
 {
     ecs_assert(table != NULL, ECS_LOCKED_STORAGE, NULL);
     ecs_assert(!table->lock, ECS_LOCKED_STORAGE, NULL);
-    (void)world;
 
     check_table_sanity(table);
 
     ecs_data_t *data = &table->data;
-    bool has_payload = data->entities.array != NULL;
-    ecs_storage_reclaim_t(&data->entities, ecs_entity_t);
-    ecs_storage_reclaim_t(&data->records, ecs_record_t*);
+    int32_t count = data->entities.count;
+    int32_t size = data->entities.size;
 
-    int32_t i, count = table->storage_count;
+    /* Only shrink tables that use less than a quarter of their storage, and
+     * leave room for the table to double before it has to grow again. This
+     * prevents a table that shrinks from immediately reallocating when rows
+     * are added back. Never shrink below the reservation of the table. */
+    if (count > (size >> 2)) {
+        return false;
+    }
+
+    int32_t target = count * 2;
+    if (target < table->reserved) {
+        target = table->reserved;
+    }
+    if (target) {
+        target = flecs_next_pow_of_2(target);
+        if (target < 2) {
+            target = 2;
+        }
+    }
+    if (target >= size) {
+        return false;
+    }
+
+    shrink_column(&data->entities, NULL, ECS_SIZEOF(ecs_entity_t), target);
+    shrink_column(&data->records, NULL, ECS_SIZEOF(ecs_record_t*), target);
+
+    int32_t i, column_count = table->storage_count;
     ecs_type_info_t **type_info = table->type_info;
-    for (i = 0; i < count; i ++) {
+    for (i = 0; i < column_count; i ++) {
         ecs_column_t *column = &data->columns[i];
         ecs_type_info_t *ti = type_info[i];
-        ecs_storage_reclaim(column, ti->size);
+        shrink_column(column, ti, ti->size, target);
     }
 
-    return has_payload;
+    world->info.table_realloc_total += target != 0;
+
+    return true;
 }
 
 int32_t flecs_table_data_count(
@@ -4333,11 +4484,17 @@ void flecs_merge_table_data(
     }
 
     /* Merge entities */
+    int32_t dst_size = dst_data->entities.size;
     flecs_merge_column(&dst_data->entities, &src_data->entities, 
         ECS_SIZEOF(ecs_entity_t), NULL);
     ecs_assert(dst_data->entities.count == src_count + dst_count, 
         ECS_INTERNAL_ERROR, NULL);
 
+    /* An empty destination takes over the source storage without realloc */
+    if (dst_count && dst_data->entities.size != dst_size) {
+        world->info.table_realloc_total ++;
+    }
+
     /* Merge record pointers */
     flecs_merge_column(&dst_data->records, &src_data->records, 
         ECS_SIZEOF(ecs_record_t*), 0);
@@ -4514,7 +4671,7 @@ int32_t* flecs_table_get_dirty_state(
     ecs_table_t *table)
 {    
     if (!table->dirty_state) {
-        int32_t column_count = table->storage_count;
+        int32_t column_count = table->storage_count + table->sw_count;
         table->dirty_state = ecs_os_malloc_n( int32_t, column_count + 1);
         ecs_assert(table->dirty_state != NULL, ECS_INTERNAL_ERROR, NULL);
         
@@ -4531,7 +4688,7 @@ int32_t* flecs_table_get_monitor(
     int32_t *dirty_state = flecs_table_get_dirty_state(table);
     ecs_assert(dirty_state != NULL, ECS_INTERNAL_ERROR, NULL);
 
-    int32_t column_count = table->storage_count;
+    int32_t column_count = table->storage_count + table->sw_count;
     return ecs_os_memdup(dirty_state, (column_count + 1) * ECS_SIZEOF(int32_t));
 }
 
@@ -4878,6 +5035,53 @@ const ecs_world_t* ecs_get_world(
 }
 
 
+#ifdef FLECS_COLUMN_ALIGNMENT
+/* Column arrays are aligned to FLECS_COLUMN_ALIGNMENT, and their size is padded
+ * to a multiple of it. This lets code that iterates columns use aligned vector
+ * loads and stores for every vector that overlaps with the column elements. 
+ * The pointer returned by malloc is stored right before the aligned array. */
+static
+void* storage_alloc(
+    ecs_size_t size)
+{
+    size = ECS_ALIGN(size, FLECS_COLUMN_ALIGNMENT);
+    void *mem = ecs_os_malloc(size + FLECS_COLUMN_ALIGNMENT + 
+        ECS_SIZEOF(void*));
+    uintptr_t array = ((uintptr_t)mem + ECS_SIZEOF(void*) + 
+        FLECS_COLUMN_ALIGNMENT - 1) & ~(uintptr_t)(FLECS_COLUMN_ALIGNMENT - 1);
+    ((void**)array)[-1] = mem;
+    return (void*)array;
+}
+
+static
+void storage_free(
+    void *array)
+{
+    if (array) {
+        ecs_os_free(((void**)array)[-1]);
+    }
+}
+
+static
+void* storage_realloc(
+    void *array,
+    ecs_size_t used,
+    ecs_size_t size)
+{
+    /* Alignment offset of a realloc'd block can change, so always copy */
+    void *result = storage_alloc(size);
+    if (array) {
+        ecs_os_memcpy(result, array, ECS_MIN(used, size));
+        storage_free(array);
+    }
+    return result;
+}
+#else
+#define storage_alloc(size) ecs_os_malloc(size)
+#define storage_free(array) ecs_os_free(array)
+#define storage_realloc(array, used, size) ecs_os_realloc(array, size)
+#endif
+
 void ecs_storage_init(
     ecs_column_t *storage,
     ecs_size_t size,
@@ -4887,7 +5091,7 @@ void ecs_storage_init(
     storage->array = NULL;
     storage->count = 0;
     if (elem_count) {
-        storage->array = ecs_os_malloc(size * elem_count);
+        storage->array = storage_alloc(size * elem_count);
     }
     storage->size = elem_count;
 }
@@ -4895,7 +5099,7 @@ void ecs_storage_init(
 void ecs_storage_fini(
     ecs_column_t *storage)
 {
-    ecs_os_free(storage->array);
+    storage_free(storage->array);
     storage->array = NULL;
     storage->count = 0;
     storage->size = 0;
@@ -4973,11 +5177,17 @@ ecs_column_t ecs_storage_copy(
     ecs_column_t *storage,
     ecs_size_t size)
 {
-    return (ecs_column_t) {
+    ecs_column_t result = {
         .count = storage->count,
-        .size = storage->size,
-        .array = ecs_os_memdup(storage->array, storage->size * size)
+        .size = storage->size
     };
+
+    if (storage->array) {
+        result.array = storage_alloc(storage->size * size);
+        ecs_os_memcpy(result.array, storage->array, storage->count * size);
+    }
+
+    return result;
 }
 
 void ecs_storage_reclaim(
@@ -4987,7 +5197,8 @@ void ecs_storage_reclaim(
     int32_t count = storage->count;
     if (count < storage->size) {
         if (count) {
-            storage->array = ecs_os_realloc(storage->array, size * count);
+            storage->array = storage_realloc(storage->array, size * count, 
+                size * count);
             storage->size = count;
         } else {
             ecs_storage_fini(storage);
@@ -5010,7 +5221,8 @@ void ecs_storage_set_size(
             elem_count = 2;
         }
         if (elem_count != storage->size) {
-            storage->array = ecs_os_realloc(storage->array, size * elem_count);
+            storage->array = storage_realloc(storage->array, 
+                size * storage->count, size * elem_count);
             storage->size = elem_count;
         }
     }
@@ -5298,6 +5510,73 @@ error:
     return NULL;
 }
 
+static
+ecs_flags32_t event_flag(
+    ecs_entity_t event)
+{
+    if (event == EcsOnAdd) {
+        return EcsIdHasOnAdd;
+    } else if (event == EcsOnRemove) {
+        return EcsIdHasOnRemove;
+    } else if (event == EcsOnSet) {
+        return EcsIdHasOnSet;
+    } else {
+        ecs_assert(event == EcsUnSet, ECS_INTERNAL_ERROR, NULL);
+        return EcsIdHasUnSet;
+    }
+}
+
+/* Test if any of the ids is observed for the event, using the flags that are
+ * cached on the id records. */
+static
+bool ids_observed(
+    ecs_world_t *world,
+    ecs_table_t *table,
+    const ecs_type_t *ids,
+    ecs_flags32_t flag)
+{
+    int32_t i, count = ids->count;
+
+    if (ids->array == table->type.array) {
+        /* Event is for all ids in the table, use the table records instead of
+         * looking up the id records */
+        ecs_table_record_t *records = table->records;
+        for (i = 0; i < count; i ++) {
+            ecs_id_record_t *idr = (ecs_id_record_t*)records[i].hdr.cache;
+            if (idr->flags & flag) {
+                return true;
+            }
+        }
+    } else {
+        for (i = 0; i < count; i ++) {
+            ecs_id_record_t *idr = flecs_get_id_record(world, ids->array[i]);
+            if (idr && (idr->flags & flag)) {
+                return true;
+            }
+        }
+    }
+
+    if (table->flags & EcsTableHasUnion) {
+        /* Triggers for union relations are registered for (Union, Relation), 
+         * which isn't necessarily in the list of ids */
+        for (i = 0; i < count; i ++) {
+            ecs_id_t id = ids->array[i];
+            if (!ECS_HAS_ROLE(id, PAIR)) {
+                continue;
+            }
+
+            ecs_entity_t r = ECS_PAIR_FIRST(id);
+            ecs_id_record_t *idr = flecs_get_id_record(world, 
+                r == EcsUnion ? id : ecs_pair(EcsUnion, r));
+            if (idr && (idr->flags & flag)) {
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
 static
 void notify(
     ecs_world_t *world,
@@ -5309,6 +5588,13 @@ void notify(
     ecs_type_t *ids,
     ecs_entity_t relation)
 {
+    if (!ids_observed(world, table, ids, event_flag(event))) {
+        world->info.event_skip_total ++;
+        return;
+    }
+
+    world->info.event_emit_total ++;
+
     flecs_emit(world, world, &(ecs_event_desc_t) {
         .event = event,
         .ids = ids,
@@ -5703,8 +5989,30 @@ void flecs_set_union(
             }
 
             int32_t r;
+            bool changed = false, first_case = false;
             for (r = 0; r < count; r ++) {
-                flecs_switch_set(sw, row + r, union_case);
+                if (flecs_switch_get(sw, row + r) != union_case) {
+                    first_case |= flecs_switch_set(sw, row + r, union_case);
+                    changed = true;
+                }
+            }
+
+            /* The dirty state of union columns comes after the regular columns,
+             * so queries and change trackers can see that a case changed */
+            if (changed) {
+                mark_table_dirty(world, table, table->storage_count + column + 1);
+            }
+
+            /* Union cases aren't registered with the id index, so flag the
+             * target to make sure it gets cleaned up when deleted. This only
+             * needs to happen when the column starts using the case. Deleting
+             * the target removes it from all columns, so a recycled id is
+             * flagged again the next time it is used. */
+            if (first_case) {
+                ecs_record_t *r_case = ecs_eis_get_any(world, union_case);
+                if (r_case) {
+                    r_case->row |= EcsEntityObservedObject;
+                }
             }
         }
     }
@@ -5890,9 +6198,19 @@ void commit(
         if (((diff->added.count) || (diff->removed.count)) && 
              src_table && src_table->flags & EcsTableHasUnion) 
         {
-            flecs_add_remove_union(world, src_table, 
-                ECS_RECORD_TO_ROW(record->row), 1,
+            int32_t row = ECS_RECORD_TO_ROW(record->row);
+            if (diff->removed.count) {
+                notify(world, src_table, src_table, row, 1, EcsOnRemove, 
+                    &diff->removed, 0);
+            }
+
+            flecs_add_remove_union(world, src_table, row, 1,
                 &diff->added, &diff->removed);
+
+            if (diff->added.count) {
+                notify(world, src_table, src_table, row, 1, EcsOnAdd, 
+                    &diff->added, 0);
+            }
         }
 
         return;
@@ -6204,10 +6522,8 @@ void flecs_notify_on_add(
             flecs_add_remove_union(world, table, row, count, &diff->added, NULL);
         }
 
-        if (table->flags & EcsTableHasOnAdd) {
-            notify(world, table, other_table, row, count, EcsOnAdd, 
-                &diff->added, 0);
-        }
+        notify(world, table, other_table, row, count, EcsOnAdd, 
+            &diff->added, 0);
     }
 
     /* When a IsA relation is added to an entity, that entity inherits the
@@ -6234,7 +6550,7 @@ void flecs_notify_on_remove(
             notify(world, table, other_table, row, count, EcsUnSet, &diff->un_set, 0);
         }
 
-        if (table->flags & EcsTableHasOnRemove && diff->removed.count) {
+        if (diff->removed.count) {
             notify(world, table, other_table, row, count, EcsOnRemove, 
                 &diff->removed, 0);
         }
@@ -7559,6 +7875,60 @@ void on_delete_action(
     ecs_log_pop_1();
 }
 
+/* Union relationships store their target in the union column instead of the
+ * table type, so the (*, Object) index doesn't find them. Use the case lists of
+ * the union columns to find the entities that have the deleted object. */
+static
+void on_delete_union_object(
+    ecs_world_t *world,
+    ecs_entity_t obj,
+    ecs_entity_t action)
+{
+    ecs_table_cache_iter_t it;
+    ecs_id_record_t *idr = flecs_table_iter(
+        world, ecs_pair(EcsUnion, EcsWildcard), &it);
+    if (!idr) {
+        return;
+    }
+
+    /* Operations are deferred, so tables don't change while iterating */
+    const ecs_table_record_t *tr;
+    while ((tr = flecs_table_cache_next(&it, ecs_table_record_t))) {
+        ecs_table_t *table = tr->hdr.table;
+        ecs_entity_t *entities = ecs_storage_first(&table->data.entities);
+        int32_t c, end = tr->column + tr->count;
+
+        for (c = tr->column; c < end; c ++) {
+            ecs_entity_t rel = ECS_PAIR_SECOND(table->type.array[c]);
+            ecs_switch_t *sw = &table->data.sw_columns[c - table->sw_offset];
+            int32_t row = flecs_switch_first(sw, ecs_entity_t_lo(obj));
+            if (row == -1) {
+                continue;
+            }
+
+            ecs_entity_t cur_action = action;
+            if (!cur_action) {
+                ecs_id_record_t *idr_r = flecs_get_id_record(world, 
+                    ecs_pair(rel, EcsWildcard));
+                ecs_assert(idr_r != NULL, ECS_INTERNAL_ERROR, NULL);
+                cur_action = ECS_ID_ON_DELETE_OBJECT(idr_r->flags);
+            }
+
+            if (cur_action == EcsPanic) {
+                throw_invalid_delete(world, ecs_pair(rel, obj));
+            }
+
+            for (; row != -1; row = flecs_switch_next(sw, row)) {
+                if (cur_action == EcsDelete) {
+                    ecs_delete(world, entities[row]);
+                } else {
+                    ecs_remove_pair(world, entities[row], rel, obj);
+                }
+            }
+        }
+    }
+}
+
 static
 void on_delete_any_w_entity(
     ecs_world_t *world,
@@ -7573,6 +7943,7 @@ void on_delete_any_w_entity(
     }
     if (flags & EcsEntityObservedObject) {
         on_delete_action(world, ecs_pair(EcsWildcard, e), action);
+        on_delete_union_object(world, e, action);
     }
 }
 
@@ -7800,6 +8171,93 @@ error:
     return NULL;
 }
 
+/* Number of entities for which records are prefetched before they're read. Small
+ * enough for prefetched cache lines to still be there when they're accessed. */
+#define ECS_GET_N_BATCH (32)
+
+void ecs_get_id_n(
+    const ecs_world_t *world,
+    const ecs_entity_t *entities,
+    int32_t count,
+    ecs_id_t id,
+    const void **ptrs_out)
+{
+    ecs_check(world != NULL, ECS_INVALID_PARAMETER, NULL);
+    ecs_check(!count || entities != NULL, ECS_INVALID_PARAMETER, NULL);
+    ecs_check(!count || ptrs_out != NULL, ECS_INVALID_PARAMETER, NULL);
+    ecs_check(flecs_stage_from_readonly_world(world)->asynchronous == false, 
+        ECS_INVALID_PARAMETER, NULL);
+
+    world = ecs_get_world(world);
+
+    ecs_id_record_t *idr = flecs_get_id_record(world, id);
+    if (!idr) {
+        ecs_os_memset_n(ptrs_out, 0, const void*, count);
+        return;
+    }
+
+    /* Entities are often stored in the same table, so cache the last lookup */
+    ecs_table_t *last_table = NULL;
+    const ecs_table_record_t *last_tr = NULL;
+    int32_t i, b;
+
+    for (b = 0; b < count; b += ECS_GET_N_BATCH) {
+        int32_t end = ECS_MIN(b + ECS_GET_N_BATCH, count);
+
+        /* Issue loads for all records in the batch first, so that the cache
+         * misses of the entity index overlap instead of being serialized. */
+        for (i = b; i < end; i ++) {
+            ecs_eis_prefetch(world, entities[i]);
+        }
+
+        for (i = b; i < end; i ++) {
+            ecs_entity_t e = entities[i];
+            ecs_check(ecs_is_valid(world, e), ECS_INVALID_PARAMETER, NULL);
+            ptrs_out[i] = NULL;
+
+            ecs_record_t *r = ecs_eis_get(world, e);
+            if (!r) {
+                continue;
+            }
+
+            ecs_table_t *table = r->table;
+            if (!table) {
+                continue;
+            }
+
+            const ecs_table_record_t *tr;
+            if (table == last_table) {
+                tr = last_tr;
+            } else {
+                tr = NULL;
+                ecs_table_t *storage_table = table->storage_table;
+                if (storage_table) {
+                    tr = flecs_id_record_table(idr, storage_table);
+                } else {
+                    ecs_check(!ecs_owns_id(world, e, id), 
+                        ECS_NOT_A_COMPONENT, NULL);
+                }
+                last_table = table;
+                last_tr = tr;
+            }
+
+            if (!tr) {
+                ptrs_out[i] = get_base_component(world, table, id, idr, 0);
+                continue;
+            }
+
+            /* Computing the pointer doesn't access component data, so prefetch
+             * it for the application. */
+            int32_t row = ECS_RECORD_TO_ROW(r->row);
+            const void *ptr = get_component_w_index(table, tr->column, row);
+            ECS_PREFETCH(ptr);
+            ptrs_out[i] = ptr;
+        }
+    }
+error:
+    return;
+}
+
 void* ecs_get_mut_id(
     ecs_world_t *world,
     ecs_entity_t entity,
@@ -8201,8 +8659,12 @@ ecs_entity_t ecs_get_object(
                 ecs_switch_t *sw = &table->data.sw_columns[
                     tr->column - table->sw_offset];
                 int32_t row = ECS_RECORD_TO_ROW(r->row);
-                return flecs_switch_get(sw, row);
-                
+                ecs_entity_t obj = flecs_switch_get(sw, row);
+                if (obj) {
+                    /* Cases are stored without generation */
+                    obj = ecs_get_alive(world, obj);
+                }
+                return obj;
             }
         }
         return 0;
@@ -10255,22 +10717,37 @@ ecs_vector_t* _ecs_vector_copy(
 }
 
 
+/** Default number of elements per chunk (log2) */
+#define FLECS_SPARSE_CHUNK_BITS (12)
+
 /** The number of elements in a single chunk */
-#define CHUNK_COUNT (4096)
+#define CHUNK_COUNT(sparse) (1 << (sparse)->chunk_bits)
 
-/** Compute the chunk index from an id by stripping the first 12 bits */
-#define CHUNK(index) ((int32_t)((uint32_t)index >> 12))
+/** Compute the chunk index from an id by stripping the offset bits */
+#define CHUNK(sparse, index) ((int32_t)((uint32_t)index >> (sparse)->chunk_bits))
 
 /** This computes the offset of an index inside a chunk */
-#define OFFSET(index) ((int32_t)index & 0xFFF)
+#define OFFSET(sparse, index) ((int32_t)index & (CHUNK_COUNT(sparse) - 1))
 
 /* Utility to get a pointer to the payload */
 #define DATA(array, size, offset) (ECS_OFFSET(array, size * offset))
 
+#ifdef FLECS_HUGEPAGES
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+/** Size & alignment of a huge page */
+#define HUGEPAGE_SIZE (2 * 1024 * 1024)
+#endif
+
 typedef struct chunk_t {
     int32_t *sparse;            /* Sparse array with indices to dense array */
     void *data;                 /* Store data in sparse array to reduce  
                                  * indirection and provide stable pointers. */
+#ifdef FLECS_HUGEPAGES
+    void *mem;                  /* Unaligned allocation */
+#endif
 } chunk_t;
 
 static
@@ -10295,16 +10772,34 @@ chunk_t* chunk_new(
     ecs_assert(result->sparse == NULL, ECS_INTERNAL_ERROR, NULL);
     ecs_assert(result->data == NULL, ECS_INTERNAL_ERROR, NULL);
 
-    /* Initialize sparse array with zero's, as zero is used to indicate that the
-     * sparse element has not been paired with a dense element. Use zero
-     * as this means we can take advantage of calloc having a possibly better 
-     * performance than malloc + memset. */
-    result->sparse = ecs_os_calloc(ECS_SIZEOF(int32_t) * CHUNK_COUNT);
+    /* The sparse and data arrays are stored in a single block, so that a
+     * chunk can be backed by a single (huge) page. Both arrays are initialized
+     * with zero's, as zero is used to indicate that the sparse element has not
+     * been paired with a dense element, and data is reset to zero when an 
+     * entry is removed. Use calloc, which can be faster than malloc + memset
+     * and for large chunks does not touch memory before it is used. */
+    ecs_size_t chunk_count = CHUNK_COUNT(sparse);
+    ecs_size_t sparse_size = ECS_SIZEOF(int32_t) * chunk_count;
+    ecs_size_t size = sparse_size + sparse->size * chunk_count;
+
+#ifdef FLECS_HUGEPAGES
+    if (size >= HUGEPAGE_SIZE) {
+        /* Align the block to a huge page, so that the OS can back it with huge
+         * pages, which reduces TLB misses for random access */
+        result->mem = ecs_os_calloc(size + HUGEPAGE_SIZE);
+        result->sparse = (int32_t*)(((uintptr_t)result->mem + HUGEPAGE_SIZE - 1) 
+            & ~(uintptr_t)(HUGEPAGE_SIZE - 1));
+#ifdef __linux__
+        madvise(result->sparse, (size_t)size, MADV_HUGEPAGE);
+#endif
+    } else {
+        result->mem = result->sparse = ecs_os_calloc(size);
+    }
+#else
+    result->sparse = ecs_os_calloc(size);
+#endif
 
-    /* Initialize the data array with zero's to guarantee that data is 
-     * always initialized. When an entry is removed, data is reset back to
-     * zero. Initialize now, as this can take advantage of calloc. */
-    result->data = ecs_os_calloc(sparse->size * CHUNK_COUNT);
+    result->data = ECS_OFFSET(result->sparse, sparse_size);
 
     ecs_assert(result->sparse != NULL, ECS_INTERNAL_ERROR, NULL);
     ecs_assert(result->data != NULL, ECS_INTERNAL_ERROR, NULL);
@@ -10316,8 +10811,11 @@ static
 void chunk_free(
     chunk_t *chunk)
 {
+#ifdef FLECS_HUGEPAGES
+    ecs_os_free(chunk->mem);
+#else
     ecs_os_free(chunk->sparse);
-    ecs_os_free(chunk->data);
+#endif
 }
 
 static
@@ -10377,6 +10875,7 @@ uint64_t strip_generation(
 
 static
 void assign_index(
+    const ecs_sparse_t *sparse,
     chunk_t * chunk, 
     uint64_t * dense_array, 
     uint64_t index, 
@@ -10384,7 +10883,7 @@ void assign_index(
 {
     /* Initialize sparse-dense pair. This assigns the dense index to the sparse
      * array, and the sparse index to the dense array .*/
-    chunk->sparse[OFFSET(index)] = dense;
+    chunk->sparse[OFFSET(sparse, index)] = dense;
     dense_array[dense] = index;
 }
 
@@ -10434,11 +10933,11 @@ uint64_t create_id(
     uint64_t index = inc_id(sparse);
     grow_dense(sparse);
 
-    chunk_t *chunk = get_or_create_chunk(sparse, CHUNK(index));
-    ecs_assert(chunk->sparse[OFFSET(index)] == 0, ECS_INTERNAL_ERROR, NULL);
+    chunk_t *chunk = get_or_create_chunk(sparse, CHUNK(sparse, index));
+    ecs_assert(chunk->sparse[OFFSET(sparse, index)] == 0, ECS_INTERNAL_ERROR, NULL);
     
     uint64_t *dense_array = ecs_vector_first(sparse->dense, uint64_t);
-    assign_index(chunk, dense_array, index, dense);
+    assign_index(sparse, chunk, dense_array, index, dense);
     
     return index;
 }
@@ -10472,12 +10971,12 @@ void* try_sparse_any(
 {    
     strip_generation(&index);
 
-    chunk_t *chunk = get_chunk(sparse, CHUNK(index));
+    chunk_t *chunk = get_chunk(sparse, CHUNK(sparse, index));
     if (!chunk) {
         return NULL;
     }
 
-    int32_t offset = OFFSET(index);
+    int32_t offset = OFFSET(sparse, index);
     int32_t dense = chunk->sparse[offset];
     bool in_use = dense && (dense < sparse->count);
     if (!in_use) {
@@ -10494,12 +10993,12 @@ void* try_sparse(
     const ecs_sparse_t *sparse,
     uint64_t index)
 {
-    chunk_t *chunk = get_chunk(sparse, CHUNK(index));
+    chunk_t *chunk = get_chunk(sparse, CHUNK(sparse, index));
     if (!chunk) {
         return NULL;
     }
 
-    int32_t offset = OFFSET(index);
+    int32_t offset = OFFSET(sparse, index);
     int32_t dense = chunk->sparse[offset];
     bool in_use = dense && (dense < sparse->count);
     if (!in_use) {
@@ -10527,8 +11026,8 @@ void* get_sparse(
     uint64_t index)
 {
     strip_generation(&index);
-    chunk_t *chunk = get_chunk(sparse, CHUNK(index));
-    int32_t offset = OFFSET(index);
+    chunk_t *chunk = get_chunk(sparse, CHUNK(sparse, index));
+    int32_t offset = OFFSET(sparse, index);
     
     ecs_assert(chunk != NULL, ECS_INTERNAL_ERROR, NULL);
     ecs_assert(dense == chunk->sparse[offset], ECS_INTERNAL_ERROR, NULL);
@@ -10551,9 +11050,9 @@ void swap_dense(
     uint64_t index_a = dense_array[a];
     uint64_t index_b = dense_array[b];
 
-    chunk_t *chunk_b = get_or_create_chunk(sparse, CHUNK(index_b));
-    assign_index(chunk_a, dense_array, index_a, b);
-    assign_index(chunk_b, dense_array, index_b, a);
+    chunk_t *chunk_b = get_or_create_chunk(sparse, CHUNK(sparse, index_b));
+    assign_index(sparse, chunk_a, dense_array, index_a, b);
+    assign_index(sparse, chunk_b, dense_array, index_b, a);
 }
 
 void _flecs_sparse_init(
@@ -10562,6 +11061,7 @@ void _flecs_sparse_init(
 {
     ecs_assert(result != NULL, ECS_OUT_OF_MEMORY, NULL);
     result->size = size;
+    result->chunk_bits = FLECS_SPARSE_CHUNK_BITS;
     result->max_id_local = UINT64_MAX;
     result->max_id = &result->max_id_local;
 
@@ -10591,6 +11091,18 @@ void flecs_sparse_set_id_source(
     sparse->max_id = id_source;
 }
 
+void flecs_sparse_set_chunk_bits(
+    ecs_sparse_t *sparse,
+    int32_t chunk_bits)
+{
+    ecs_assert(sparse != NULL, ECS_INVALID_PARAMETER, NULL);
+    ecs_assert(sparse->chunks == NULL, ECS_INVALID_OPERATION, 
+        "cannot change chunk size of sparse set that has chunks");
+    ecs_assert(chunk_bits >= 4 && chunk_bits <= 24, ECS_INVALID_PARAMETER, 
+        NULL);
+    sparse->chunk_bits = chunk_bits;
+}
+
 void flecs_sparse_clear(
     ecs_sparse_t *sparse)
 {
@@ -10664,9 +11176,9 @@ void* _flecs_sparse_add(
     ecs_assert(sparse != NULL, ECS_INVALID_PARAMETER, NULL);
     ecs_assert(!size || size == sparse->size, ECS_INVALID_PARAMETER, NULL);
     uint64_t index = new_index(sparse);
-    chunk_t *chunk = get_chunk(sparse, CHUNK(index));
+    chunk_t *chunk = get_chunk(sparse, CHUNK(sparse, index));
     ecs_assert(chunk != NULL, ECS_INTERNAL_ERROR, NULL);
-    return DATA(chunk->data, size, OFFSET(index));
+    return DATA(chunk->data, size, OFFSET(sparse, index));
 }
 
 uint64_t flecs_sparse_last_id(
@@ -10688,8 +11200,8 @@ void* _flecs_sparse_ensure(
     (void)size;
 
     uint64_t gen = strip_generation(&index);
-    chunk_t *chunk = get_or_create_chunk(sparse, CHUNK(index));
-    int32_t offset = OFFSET(index);
+    chunk_t *chunk = get_or_create_chunk(sparse, CHUNK(sparse, index));
+    int32_t offset = OFFSET(sparse, index);
     int32_t dense = chunk->sparse[offset];
 
     if (dense) {
@@ -10737,11 +11249,11 @@ void* _flecs_sparse_ensure(
             /* If there are unused elements in the list, move the first unused
              * element to the end of the list */
             uint64_t unused = dense_array[count];
-            chunk_t *unused_chunk = get_or_create_chunk(sparse, CHUNK(unused));
-            assign_index(unused_chunk, dense_array, unused, dense_count);
+            chunk_t *unused_chunk = get_or_create_chunk(sparse, CHUNK(sparse, unused));
+            assign_index(sparse, unused_chunk, dense_array, unused, dense_count);
         }
 
-        assign_index(chunk, dense_array, index, count);
+        assign_index(sparse, chunk, dense_array, index, count);
         dense_array[count] |= gen;
     }
 
@@ -10768,9 +11280,9 @@ void* _flecs_sparse_remove_get(
     ecs_assert(!size || size == sparse->size, ECS_INVALID_PARAMETER, NULL);
     (void)size;
 
-    chunk_t *chunk = get_or_create_chunk(sparse, CHUNK(index));
+    chunk_t *chunk = get_or_create_chunk(sparse, CHUNK(sparse, index));
     uint64_t gen = strip_generation(&index);
-    int32_t offset = OFFSET(index);
+    int32_t offset = OFFSET(sparse, index);
     int32_t dense = chunk->sparse[offset];
 
     if (dense) {
@@ -10822,11 +11334,11 @@ void flecs_sparse_set_generation(
     uint64_t index)
 {
     ecs_assert(sparse != NULL, ECS_INVALID_PARAMETER, NULL);
-    chunk_t *chunk = get_or_create_chunk(sparse, CHUNK(index));
+    chunk_t *chunk = get_or_create_chunk(sparse, CHUNK(sparse, index));
     
     uint64_t index_w_gen = index;
     strip_generation(&index);
-    int32_t offset = OFFSET(index);
+    int32_t offset = OFFSET(sparse, index);
     int32_t dense = chunk->sparse[offset];
 
     if (dense) {
@@ -10843,13 +11355,13 @@ bool flecs_sparse_exists(
     uint64_t index)
 {
     ecs_assert(sparse != NULL, ECS_INVALID_PARAMETER, NULL);
-    chunk_t *chunk = get_chunk(sparse, CHUNK(index));
+    chunk_t *chunk = get_chunk(sparse, CHUNK(sparse, index));
     if (!chunk) {
         return false;
     }
     
     strip_generation(&index);
-    int32_t offset = OFFSET(index);
+    int32_t offset = OFFSET(sparse, index);
     int32_t dense = chunk->sparse[offset];
 
     return dense != 0;
@@ -10882,12 +11394,12 @@ uint64_t flecs_sparse_get_alive(
     const ecs_sparse_t *sparse,
     uint64_t index)
 {
-    chunk_t *chunk = get_chunk(sparse, CHUNK(index));
+    chunk_t *chunk = get_chunk(sparse, CHUNK(sparse, index));
     if (!chunk) {
         return 0;
     }
 
-    int32_t offset = OFFSET(index);
+    int32_t offset = OFFSET(sparse, index);
     int32_t dense = chunk->sparse[offset];
     uint64_t *dense_array = ecs_vector_first(sparse->dense, uint64_t);
 
@@ -10907,6 +11419,21 @@ void* _flecs_sparse_get(
     return try_sparse(sparse, index);
 }
 
+void flecs_sparse_prefetch(
+    const ecs_sparse_t *sparse,
+    uint64_t index)
+{
+    ecs_assert(sparse != NULL, ECS_INVALID_PARAMETER, NULL);
+    chunk_t *chunk = get_chunk(sparse, CHUNK(sparse, index));
+    if (!chunk) {
+        return;
+    }
+
+    int32_t offset = OFFSET(sparse, index);
+    ECS_PREFETCH(&chunk->sparse[offset]);
+    ECS_PREFETCH(DATA(chunk->data, sparse->size, offset));
+}
+
 void* _flecs_sparse_get_any(
     const ecs_sparse_t *sparse,
     ecs_size_t size,
@@ -10996,6 +11523,7 @@ ecs_sparse_t* flecs_sparse_copy(
     }
 
     ecs_sparse_t *dst = _flecs_sparse_new(src->size);
+    flecs_sparse_set_chunk_bits(dst, src->chunk_bits);
     sparse_copy(dst, src);
 
     return dst;
@@ -11289,7 +11817,7 @@ void flecs_switch_addn(
     flecs_switch_set_count(sw, old_count + count);
 }
 
-void flecs_switch_set(
+bool flecs_switch_set(
     ecs_switch_t *sw,
     int32_t element,
     uint64_t value)
@@ -11304,7 +11832,7 @@ void flecs_switch_set(
 
     /* If the node is already assigned to the value, nothing to be done */
     if (cur_value == value) {
-        return;
+        return false;
     }
 
     ecs_switch_node_t *nodes = ecs_vector_first(sw->nodes, ecs_switch_node_t);
@@ -11340,8 +11868,12 @@ void flecs_switch_set(
         }
 
         dst_hdr->element = element;
-        dst_hdr->count ++;        
+        dst_hdr->count ++;
+
+        return dst_hdr->count == 1;
     }
+
+    return false;
 }
 
 void flecs_switch_remove(
@@ -11677,6 +12209,8 @@ error:
 #pragma GCC diagnostic ignored "-Wimplicit-fallthrough"
 #endif
 
+#if defined(FLECS_HASH_JENKINS)
+
 /* See explanation below. The hashing function may read beyond the memory passed
  * into the hashing function, but only at word boundaries. This should be safe,
  * but trips up address sanitizers and valgrind.
@@ -12008,6 +12542,157 @@ uint64_t flecs_hash(
     return h_1 | ((uint64_t)h_2 << 32);
 }
 
+#elif defined(FLECS_HASH_CUSTOM)
+
+uint64_t flecs_hash(
+    const void *data,
+    ecs_size_t length)
+{
+    return flecs_hash_custom(data, length);
+}
+
+#else
+
+/*
+-------------------------------------------------------------------------------
+wyhash (final version 4), by Wang Yi, released into the public domain.
+  https://github.com/wangyi-fudan/wyhash
+-------------------------------------------------------------------------------
+*/
+
+#if defined(_MSC_VER) && defined(_M_X64) && !defined(__clang__)
+#include <intrin.h>
+#pragma intrinsic(_umul128)
+#endif
+
+/* 128 bit multiply of a and b, low half is stored in a, high half in b */
+static
+void wymum(
+    uint64_t *a,
+    uint64_t *b)
+{
+#if defined(__SIZEOF_INT128__)
+    __uint128_t r = *a;
+    r *= *b;
+    *a = (uint64_t)r;
+    *b = (uint64_t)(r >> 64);
+#elif defined(_MSC_VER) && defined(_M_X64) && !defined(__clang__)
+    *a = _umul128(*a, *b, b);
+#else
+    uint64_t ha = *a >> 32, hb = *b >> 32;
+    uint64_t la = (uint32_t)*a, lb = (uint32_t)*b;
+    uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+    uint64_t t = rl + (rm0 << 32), c = t < rl, lo, hi;
+    lo = t + (rm1 << 32);
+    c += lo < t;
+    hi = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+    *a = lo;
+    *b = hi;
+#endif
+}
+
+static
+uint64_t wymix(
+    uint64_t a,
+    uint64_t b)
+{
+    wymum(&a, &b);
+    return a ^ b;
+}
+
+/* Reads are unaligned and in native byte order. Hashes only need to be stable
+ * within a process, so big endian targets get different (but equally good)
+ * hash values. */
+static
+uint64_t wyr8(
+    const uint8_t *p)
+{
+    uint64_t v;
+    ecs_os_memcpy(&v, p, 8);
+    return v;
+}
+
+static
+uint64_t wyr4(
+    const uint8_t *p)
+{
+    uint32_t v;
+    ecs_os_memcpy(&v, p, 4);
+    return v;
+}
+
+static
+uint64_t wyr3(
+    const uint8_t *p,
+    size_t k)
+{
+    return (((uint64_t)p[0]) << 16) | (((uint64_t)p[k >> 1]) << 8) | p[k - 1];
+}
+
+static const uint64_t wyp[4] = {
+    0x2d358dccaa6c78a5ull, 0x8bb84b93962eacc9ull, 
+    0x4b33a62ed433d4a3ull, 0x4d5a2da51de1aa47ull
+};
+
+static
+uint64_t wyhash(
+    const void *key,
+    size_t len,
+    uint64_t seed)
+{
+    const uint8_t *p = key;
+    uint64_t a, b;
+    seed ^= wymix(seed ^ wyp[0], wyp[1]);
+
+    if (len <= 16) {
+        /* Type id arrays with 1 or 2 ids and most names end up here */
+        if (len >= 4) {
+            size_t off = (len >> 3) << 2;
+            a = (wyr4(p) << 32) | wyr4(p + off);
+            b = (wyr4(p + len - 4) << 32) | wyr4(p + len - 4 - off);
+        } else if (len > 0) {
+            a = wyr3(p, len);
+            b = 0;
+        } else {
+            a = b = 0;
+        }
+    } else {
+        size_t i = len;
+        if (i > 48) {
+            uint64_t see1 = seed, see2 = seed;
+            do {
+                seed = wymix(wyr8(p) ^ wyp[1], wyr8(p + 8) ^ seed);
+                see1 = wymix(wyr8(p + 16) ^ wyp[2], wyr8(p + 24) ^ see1);
+                see2 = wymix(wyr8(p + 32) ^ wyp[3], wyr8(p + 40) ^ see2);
+                p += 48;
+                i -= 48;
+            } while (i > 48);
+            seed ^= see1 ^ see2;
+        }
+        while (i > 16) {
+            seed = wymix(wyr8(p) ^ wyp[1], wyr8(p + 8) ^ seed);
+            i -= 16;
+            p += 16;
+        }
+        a = wyr8(p + i - 16);
+        b = wyr8(p + i - 8);
+    }
+
+    a ^= wyp[1];
+    b ^= seed;
+    wymum(&a, &b);
+    return wymix(a ^ wyp[0] ^ len, b ^ wyp[1]);
+}
+
+uint64_t flecs_hash(
+    const void *data,
+    ecs_size_t length)
+{
+    return wyhash(data, flecs_ito(size_t, length), 0);
+}
+
+#endif
+
 
 void ecs_qsort(
     void *base, 
@@ -12072,6 +12757,7 @@ void flecs_bitset_fini(
     ecs_os_free(bs->data);
     bs->data = NULL;
     bs->count = 0;
+    bs->size = 0;
 }
 
 void flecs_bitset_addn(
@@ -12120,6 +12806,9 @@ void flecs_bitset_remove(
     int32_t last = bs->count - 1;
     bool last_value = flecs_bitset_get(bs, last);
     flecs_bitset_set(bs, elem, last_value);
+
+    /* Clear removed bit, so iteration doesn't find bits past the last element */
+    flecs_bitset_set(bs, last, false);
     bs->count --;
 error:
     return;
@@ -12144,74 +12833,389 @@ error:
 #include <stdio.h>
 #include <math.h>
 
-/**
- *  stm32tpl --  STM32 C++ Template Peripheral Library
- *  Visit https://github.com/antongus/stm32tpl for new versions
- *
- *  Copyright (c) 2011-2020 Anton B. Gusev aka AHTOXA
- */
+/* Number formatting. Integers are converted two digits at a time with a 
+ * lookup table. Floating point numbers are converted with Grisu2 (Loitsch, 
+ * "Printing Floating-Point Numbers Quickly and Accurately with Integers"),
+ * which uses integer math to find a short digit sequence that round trips to
+ * the original value. Single precision values are formatted with the 
+ * boundaries of a float, so that 0.1f is written as 0.1. */
+
+/* Max number of trailing integer zeros before switching to exponent */
+#define EXP_THRESHOLD (3)
+
+/* Max number of leading fraction zeros before switching to exponent */
+#define EXP_THRESHOLD_FRAC (6)
+
+/* Grisu2 target range for the binary exponent of scaled values */
+#define GRISU_ALPHA (-60)
+#define GRISU_GAMMA (-32)
+
+static const char strbuf_digits[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+static const uint32_t strbuf_pow10[] = {
+    1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000
+};
 
-#define MAX_PRECISION	(10)
-#define EXP_THRESHOLD   (3)
-#define INT64_MAX_F ((double)INT64_MAX)
-
-static const double rounders[MAX_PRECISION + 1] =
-{
-	0.5,				// 0
-	0.05,				// 1
-	0.005,				// 2
-	0.0005,				// 3
-	0.00005,			// 4
-	0.000005,			// 5
-	0.0000005,			// 6
-	0.00000005,			// 7
-	0.000000005,		// 8
-	0.0000000005,		// 9
-	0.00000000005		// 10
+typedef struct {
+    uint64_t f;
+    int32_t e;
+} strbuf_diyfp_t;
+
+typedef struct {
+    uint64_t f;
+    int32_t e;
+    int32_t k;
+} strbuf_cached_power_t;
+
+/* Normalized approximations of 10^k for k = -300, -292, ..., 324 */
+static const strbuf_cached_power_t strbuf_cached_powers[] = {
+    { 0xAB70FE17C79AC6CA, -1060, -300 },
+    { 0xFF77B1FCBEBCDC4F, -1034, -292 },
+    { 0xBE5691EF416BD60C, -1007, -284 },
+    { 0x8DD01FAD907FFC3C,  -980, -276 },
+    { 0xD3515C2831559A83,  -954, -268 },
+    { 0x9D71AC8FADA6C9B5,  -927, -260 },
+    { 0xEA9C227723EE8BCB,  -901, -252 },
+    { 0xAECC49914078536D,  -874, -244 },
+    { 0x823C12795DB6CE57,  -847, -236 },
+    { 0xC21094364DFB5637,  -821, -228 },
+    { 0x9096EA6F3848984F,  -794, -220 },
+    { 0xD77485CB25823AC7,  -768, -212 },
+    { 0xA086CFCD97BF97F4,  -741, -204 },
+    { 0xEF340A98172AACE5,  -715, -196 },
+    { 0xB23867FB2A35B28E,  -688, -188 },
+    { 0x84C8D4DFD2C63F3B,  -661, -180 },
+    { 0xC5DD44271AD3CDBA,  -635, -172 },
+    { 0x936B9FCEBB25C996,  -608, -164 },
+    { 0xDBAC6C247D62A584,  -582, -156 },
+    { 0xA3AB66580D5FDAF6,  -555, -148 },
+    { 0xF3E2F893DEC3F126,  -529, -140 },
+    { 0xB5B5ADA8AAFF80B8,  -502, -132 },
+    { 0x87625F056C7C4A8B,  -475, -124 },
+    { 0xC9BCFF6034C13053,  -449, -116 },
+    { 0x964E858C91BA2655,  -422, -108 },
+    { 0xDFF9772470297EBD,  -396, -100 },
+    { 0xA6DFBD9FB8E5B88F,  -369,  -92 },
+    { 0xF8A95FCF88747D94,  -343,  -84 },
+    { 0xB94470938FA89BCF,  -316,  -76 },
+    { 0x8A08F0F8BF0F156B,  -289,  -68 },
+    { 0xCDB02555653131B6,  -263,  -60 },
+    { 0x993FE2C6D07B7FAC,  -236,  -52 },
+    { 0xE45C10C42A2B3B06,  -210,  -44 },
+    { 0xAA242499697392D3,  -183,  -36 },
+    { 0xFD87B5F28300CA0E,  -157,  -28 },
+    { 0xBCE5086492111AEB,  -130,  -20 },
+    { 0x8CBCCC096F5088CC,  -103,  -12 },
+    { 0xD1B71758E219652C,   -77,   -4 },
+    { 0x9C40000000000000,   -50,    4 },
+    { 0xE8D4A51000000000,   -24,   12 },
+    { 0xAD78EBC5AC620000,     3,   20 },
+    { 0x813F3978F8940984,    30,   28 },
+    { 0xC097CE7BC90715B3,    56,   36 },
+    { 0x8F7E32CE7BEA5C70,    83,   44 },
+    { 0xD5D238A4ABE98068,   109,   52 },
+    { 0x9F4F2726179A2245,   136,   60 },
+    { 0xED63A231D4C4FB27,   162,   68 },
+    { 0xB0DE65388CC8ADA8,   189,   76 },
+    { 0x83C7088E1AAB65DB,   216,   84 },
+    { 0xC45D1DF942711D9A,   242,   92 },
+    { 0x924D692CA61BE758,   269,  100 },
+    { 0xDA01EE641A708DEA,   295,  108 },
+    { 0xA26DA3999AEF774A,   322,  116 },
+    { 0xF209787BB47D6B85,   348,  124 },
+    { 0xB454E4A179DD1877,   375,  132 },
+    { 0x865B86925B9BC5C2,   402,  140 },
+    { 0xC83553C5C8965D3D,   428,  148 },
+    { 0x952AB45CFA97A0B3,   455,  156 },
+    { 0xDE469FBD99A05FE3,   481,  164 },
+    { 0xA59BC234DB398C25,   508,  172 },
+    { 0xF6C69A72A3989F5C,   534,  180 },
+    { 0xB7DCBF5354E9BECE,   561,  188 },
+    { 0x88FCF317F22241E2,   588,  196 },
+    { 0xCC20CE9BD35C78A5,   614,  204 },
+    { 0x98165AF37B2153DF,   641,  212 },
+    { 0xE2A0B5DC971F303A,   667,  220 },
+    { 0xA8D9D1535CE3B396,   694,  228 },
+    { 0xFB9B7CD9A4A7443C,   720,  236 },
+    { 0xBB764C4CA7A44410,   747,  244 },
+    { 0x8BAB8EEFB6409C1A,   774,  252 },
+    { 0xD01FEF10A657842C,   800,  260 },
+    { 0x9B10A4E5E9913129,   827,  268 },
+    { 0xE7109BFBA19C0C9D,   853,  276 },
+    { 0xAC2820D9623BF429,   880,  284 },
+    { 0x80444B5E7AA7CF85,   907,  292 },
+    { 0xBF21E44003ACDD2D,   933,  300 },
+    { 0x8E679C2F5E44FF8F,   960,  308 },
+    { 0xD433179D9C8CB841,   986,  316 },
+    { 0x9E19DB92B4E31BA9,  1013,  324 },
 };
 
+static
+char* strbuf_utoa(
+    char *buf,
+    uint64_t v)
+{
+    char tmp[20];
+    char *ptr = &tmp[20];
+
+    while (v >= 100) {
+        const char *d = &strbuf_digits[(v % 100) * 2];
+        v /= 100;
+        ptr -= 2;
+        ptr[0] = d[0];
+        ptr[1] = d[1];
+    }
+
+    if (v >= 10) {
+        const char *d = &strbuf_digits[v * 2];
+        ptr -= 2;
+        ptr[0] = d[0];
+        ptr[1] = d[1];
+    } else {
+        ptr --;
+        ptr[0] = (char)('0' + v);
+    }
+
+    int32_t len = (int32_t)(&tmp[20] - ptr);
+    ecs_os_memcpy(buf, ptr, len);
+    return buf + len;
+}
+
 static
 char* strbuf_itoa(
     char *buf,
     int64_t v)
 {
-    char *ptr = buf;
-    char * p1;
-	char c;
-
-	if (!v) {
-		*ptr++ = '0';
-    } else {
-		char *p = ptr;
-		while (v) {
-			*p++ = (char)('0' + v % 10);
-			v /= 10;
-		}
-
-		p1 = p;
-
-		while (p > ptr) {
-			c = *--p;
-			*p = *ptr;
-			*ptr++ = c;
-		}
-		ptr = p1;
-	}
-    return ptr;
+    uint64_t uv = (uint64_t)v;
+    if (v < 0) {
+        buf[0] = '-';
+        buf ++;
+        uv = 0 - uv;
+    }
+    return strbuf_utoa(buf, uv);
+}
+
+static
+strbuf_diyfp_t strbuf_diyfp_mul(
+    strbuf_diyfp_t x,
+    strbuf_diyfp_t y)
+{
+    uint64_t x_lo = x.f & 0xFFFFFFFFu, x_hi = x.f >> 32;
+    uint64_t y_lo = y.f & 0xFFFFFFFFu, y_hi = y.f >> 32;
+    uint64_t p0 = x_lo * y_lo;
+    uint64_t p1 = x_lo * y_hi;
+    uint64_t p2 = x_hi * y_lo;
+    uint64_t p3 = x_hi * y_hi;
+    uint64_t q = (p0 >> 32) + (p1 & 0xFFFFFFFFu) + (p2 & 0xFFFFFFFFu);
+    q += (uint64_t)1 << 31; /* Round upper half */
+    uint64_t h = p3 + (p2 >> 32) + (p1 >> 32) + (q >> 32);
+    return (strbuf_diyfp_t){ h, x.e + y.e + 64 };
+}
+
+static
+strbuf_diyfp_t strbuf_diyfp_normalize(
+    strbuf_diyfp_t x)
+{
+    /* Binary search for the highest bit, x.f is never 0 */
+    int32_t shift;
+    for (shift = 32; shift; shift /= 2) {
+        if (!(x.f >> (64 - shift))) {
+            x.f <<= shift;
+            x.e -= shift;
+        }
+    }
+    return x;
+}
+
+/* Compute normalized value and the boundaries of the interval of numbers that
+ * round to the value. Any number inside the boundaries round trips. */
+static
+void strbuf_grisu2_boundaries(
+    double value,
+    bool single,
+    strbuf_diyfp_t *w_out,
+    strbuf_diyfp_t *minus_out,
+    strbuf_diyfp_t *plus_out)
+{
+    uint64_t F, E;
+    int32_t precision, bias;
+
+    if (single) {
+        float fv = (float)value;
+        uint32_t bits;
+        ecs_os_memcpy(&bits, &fv, ECS_SIZEOF(float));
+        precision = 24;
+        bias = 127 + 23;
+        E = bits >> 23;
+        F = bits & ((1u << 23) - 1);
+    } else {
+        uint64_t bits;
+        ecs_os_memcpy(&bits, &value, ECS_SIZEOF(double));
+        precision = 53;
+        bias = 1023 + 52;
+        E = bits >> 52;
+        F = bits & (((uint64_t)1 << 52) - 1);
+    }
+
+    strbuf_diyfp_t v;
+    if (!E) { /* Denormal */
+        v = (strbuf_diyfp_t){ F, 1 - bias };
+    } else {
+        v = (strbuf_diyfp_t){ F + ((uint64_t)1 << (precision - 1)), 
+            (int32_t)E - bias };
+    }
+
+    /* When the significand is a power of two the lower boundary is closer */
+    bool lower_closer = !F && E > 1;
+    strbuf_diyfp_t plus = { 2 * v.f + 1, v.e - 1 };
+    strbuf_diyfp_t minus = lower_closer 
+        ? (strbuf_diyfp_t){ 4 * v.f - 1, v.e - 2 }
+        : (strbuf_diyfp_t){ 2 * v.f - 1, v.e - 1 };
+
+    if (E) {
+        /* Normal values have a known number of significant bits */
+        int32_t shift = 64 - precision;
+        v.f <<= shift;
+        v.e -= shift;
+        plus.f <<= shift - 1;
+        plus.e -= shift - 1;
+    } else {
+        v = strbuf_diyfp_normalize(v);
+        plus = strbuf_diyfp_normalize(plus);
+    }
+
+    minus.f <<= minus.e - plus.e;
+    minus.e = plus.e;
+
+    *w_out = v;
+    *minus_out = minus;
+    *plus_out = plus;
+}
+
+static
+void strbuf_grisu2_round(
+    char *buf,
+    int32_t len,
+    uint64_t dist,
+    uint64_t delta,
+    uint64_t rest,
+    uint64_t ten_k)
+{
+    /* Move last digit closer to the actual value while staying in range */
+    while (rest < dist && delta - rest >= ten_k &&
+        (rest + ten_k < dist || dist - rest > rest + ten_k - dist))
+    {
+        buf[len - 1] --;
+        rest += ten_k;
+    }
+}
+
+static
+int32_t strbuf_grisu2_digits(
+    char *buf,
+    int32_t *exp,
+    strbuf_diyfp_t minus,
+    strbuf_diyfp_t w,
+    strbuf_diyfp_t plus)
+{
+    uint64_t delta = plus.f - minus.f;
+    uint64_t dist = plus.f - w.f;
+    int32_t shift = -plus.e;
+    uint64_t one = (uint64_t)1 << shift;
+    uint32_t p1 = (uint32_t)(plus.f >> shift);
+    uint64_t p2 = plus.f & (one - 1);
+    int32_t len = 0;
+
+    /* Integral digits. Convert all digits at once, which avoids divisions by
+     * a variable power of ten, then find the shortest prefix within range. */
+    char int_digits[20];
+    int32_t i, n = (int32_t)(strbuf_utoa(int_digits, p1) - int_digits);
+    uint32_t prefix = 0;
+    for (i = 0; i < n; i ++) {
+        buf[len ++] = int_digits[i];
+        prefix = prefix * 10 + (uint32_t)(int_digits[i] - '0');
+
+        uint32_t pow10 = strbuf_pow10[n - i - 1];
+        uint64_t rest = ((uint64_t)(p1 - prefix * pow10) << shift) + p2;
+        if (rest <= delta) {
+            *exp += n - i - 1;
+            strbuf_grisu2_round(buf, len, dist, delta, rest, 
+                (uint64_t)pow10 << shift);
+            return len;
+        }
+    }
+
+    /* Fractional digits */
+    int32_t m = 0;
+    do {
+        p2 *= 10;
+        buf[len ++] = (char)('0' + (p2 >> shift));
+        p2 &= one - 1;
+        delta *= 10;
+        dist *= 10;
+        m ++;
+    } while (p2 > delta);
+
+    *exp -= m;
+    strbuf_grisu2_round(buf, len, dist, delta, p2, one);
+    return len;
+}
+
+/* Convert a positive, finite, non-zero value to digits, such that the value is
+ * digits * 10^exp. Returns the number of digits. */
+static
+int32_t strbuf_grisu2(
+    char *buf,
+    int32_t *exp,
+    double value,
+    bool single)
+{
+    strbuf_diyfp_t w, minus, plus;
+    strbuf_grisu2_boundaries(value, single, &w, &minus, &plus);
+
+    /* Find cached power of ten that scales the boundaries into the range
+     * [alpha, gamma], so digits can be generated with 64bit integer math. */
+    int32_t f = GRISU_ALPHA - plus.e - 1;
+    int32_t k = (f * 78913) / (1 << 18) + (f > 0);
+    int32_t index = (300 + k + 7) / 8;
+    const strbuf_cached_power_t *cached = &strbuf_cached_powers[index];
+    strbuf_diyfp_t c = { cached->f, cached->e };
+    ecs_assert(cached->e + plus.e + 64 >= GRISU_ALPHA, 
+        ECS_INTERNAL_ERROR, NULL);
+    ecs_assert(cached->e + plus.e + 64 <= GRISU_GAMMA, 
+        ECS_INTERNAL_ERROR, NULL);
+
+    w = strbuf_diyfp_mul(w, c);
+    minus = strbuf_diyfp_mul(minus, c);
+    plus = strbuf_diyfp_mul(plus, c);
+
+    /* Account for the rounding errors of the multiplications */
+    minus.f ++;
+    plus.f --;
+
+    *exp = -cached->k;
+    return strbuf_grisu2_digits(buf, exp, minus, w, plus);
 }
 
 static
-int ecs_strbuf_ftoa(
+bool ecs_strbuf_ftoa(
     ecs_strbuf_t *out, 
     double f, 
-    int precision,
+    bool single,
     char nan_delim)
 {
     char buf[64];
-	char * ptr = buf;
-	char c;
-	int64_t intPart;
-    int64_t exp = 0;
+    char *ptr = buf;
 
     if (isnan(f)) {
         if (nan_delim) {
@@ -12232,118 +13236,100 @@ int ecs_strbuf_ftoa(
         }
     }
 
-	if (precision > MAX_PRECISION) {
-		precision = MAX_PRECISION;
-    }
-
-	if (f < 0) {
-		f = -f;
-		*ptr++ = '-';
-	}
-
-	if (precision < 0) {
-		if (f < 1.0) precision = 6;
-		else if (f < 10.0) precision = 5;
-		else if (f < 100.0) precision = 4;
-		else if (f < 1000.0) precision = 3;
-		else if (f < 10000.0) precision = 2;
-		else if (f < 100000.0) precision = 1;
-		else precision = 0;
-	}
-
-	if (precision) {
-		f += rounders[precision];
-    }
-
-    /* Make sure that number can be represented as 64bit int, increase exp */
-    while (f > INT64_MAX_F) {
-        f /= 1000 * 1000 * 1000;
-        exp += 9;
-    }
-
-	intPart = (int64_t)f;
-	f -= (double)intPart;
-
-    ptr = strbuf_itoa(ptr, intPart);
-
-	if (precision) {
-		*ptr++ = '.';
-		while (precision--) {
-			f *= 10.0;
-			c = (char)f;
-			*ptr++ = (char)('0' + c);
-			f -= c;
-		}
-	}
-	*ptr = 0;
-
-    /* Remove trailing 0s */
-    while ((&ptr[-1] != buf) && (ptr[-1] == '0')) {
-        ptr[-1] = '\0';
-        ptr --;
-    }
-    if (ptr != buf && ptr[-1] == '.') {
-        ptr[-1] = '\0';
-        ptr --;
-    }
-
-    /* If 0s before . exceed threshold, convert to exponent to save space 
-     * without losing precision. */
-    char *cur = ptr;
-    while ((&cur[-1] != buf) && (cur[-1] == '0')) {
-        cur --;
+    if (f == 0) {
+        return ecs_strbuf_appendch(out, '0');
     }
 
-    if (exp || ((ptr - cur) > EXP_THRESHOLD)) {
-        cur[0] = '\0';
-        exp += (ptr - cur);
-        ptr = cur;
+    if (f < 0) {
+        f = -f;
+        *ptr++ = '-';
     }
 
-    if (exp) {
-        char *p1 = &buf[1];
+    char digits[20];
+    int32_t exp;
+    int32_t len = strbuf_grisu2(digits, &exp, f, single);
+    while (len > 1 && digits[len - 1] == '0') {
+        len --;
+        exp ++;
+    }
+
+    /* Position of the decimal point relative to the first digit */
+    int32_t point = len + exp;
+
+    if (exp >= 0 && exp <= EXP_THRESHOLD) {
+        /* Integer */
+        ecs_os_memcpy(ptr, digits, len);
+        ptr += len;
+        ecs_os_memset(ptr, '0', exp);
+        ptr += exp;
+    } else if (exp < 0 && point > 0) {
+        /* Decimal point inside digits */
+        ecs_os_memcpy(ptr, digits, point);
+        ptr += point;
+        ptr[0] = '.';
+        ecs_os_memcpy(ptr + 1, &digits[point], len - point);
+        ptr += 1 + len - point;
+    } else if (exp < 0 && -point <= EXP_THRESHOLD_FRAC) {
+        /* Value smaller than 1 with a small number of leading zeros */
+        ptr[0] = '0';
+        ptr[1] = '.';
+        ptr += 2;
+        ecs_os_memset(ptr, '0', -point);
+        ptr -= point;
+        ecs_os_memcpy(ptr, digits, len);
+        ptr += len;
+    } else {
+        /* Exponent notation, delimited as it is not valid in all formats */
         if (nan_delim) {
-            ecs_os_memmove(buf + 1, buf, 1 + (ptr - buf));
+            ecs_os_memmove(buf + 1, buf, ptr - buf);
             buf[0] = nan_delim;
-            p1 ++;
+            ptr ++;
         }
 
-        /* Make sure that exp starts after first character */
-        c = p1[0];
-
-        if (c) {
-            p1[0] = '.';
-            do {
-                char t = (++p1)[0];
-                p1[0] = c;
-                c = t;
-                exp ++;
-            } while (c);
-            ptr = p1 + 1;
-        } else {
-            ptr = p1;
+        ptr[0] = digits[0];
+        ptr ++;
+        if (len > 1) {
+            ptr[0] = '.';
+            ecs_os_memcpy(ptr + 1, &digits[1], len - 1);
+            ptr += len;
         }
 
-
         ptr[0] = 'e';
-        ptr = strbuf_itoa(ptr + 1, exp);
+        ptr = strbuf_itoa(ptr + 1, point - 1);
 
         if (nan_delim) {
             ptr[0] = nan_delim;
             ptr ++;
         }
-
-        ptr[0] = '\0';
     }
-    
+
     return ecs_strbuf_appendstrn(out, buf, (int32_t)(ptr - buf));
 }
 
+/* Hand contents of current element to flush callback and reuse element */
+static
+void ecs_strbuf_flush_current(
+    ecs_strbuf_t *b)
+{
+    ecs_strbuf_element *e = b->current;
+    ecs_assert(e == &b->firstElement.super, ECS_INTERNAL_ERROR, NULL);
+    if (e->pos) {
+        b->flush(e->buf, e->pos, b->flush_ctx);
+        b->size += e->pos;
+        e->pos = 0;
+    }
+}
+
 /* Add an extra element to the buffer */
 static
 void ecs_strbuf_grow(
     ecs_strbuf_t *b)
 {
+    if (b->flush) {
+        ecs_strbuf_flush_current(b);
+        return;
+    }
+
     /* Allocate new element */
     ecs_strbuf_element_embedded *e = ecs_os_malloc_t(ecs_strbuf_element_embedded);
     b->size += b->current->pos;
@@ -12364,6 +13350,18 @@ void ecs_strbuf_grow_str(
     char *alloc_str,
     int32_t size)
 {
+    if (b->flush) {
+        /* Flush string directly, don't store it in the buffer */
+        ecs_strbuf_flush_current(b);
+        if (!size) {
+            size = ecs_os_strlen(str);
+        }
+        b->flush(str, size, b->flush_ctx);
+        b->size += size;
+        ecs_os_free(alloc_str);
+        return;
+    }
+
     /* Allocate new element */
     ecs_strbuf_element_str *e = ecs_os_malloc_t(ecs_strbuf_element_str);
     b->size += b->current->pos;
@@ -12563,6 +13561,44 @@ bool appendstr(
     return ecs_strbuf_memLeft(b) > 0;
 }
 
+static
+bool appendbin(
+    ecs_strbuf_t *b,
+    const void* data,
+    int32_t n)
+{
+    ecs_strbuf_init(b);
+
+    int32_t memLeftInElement = ecs_strbuf_memLeftInCurrentElement(b);
+    int32_t memLeft = ecs_strbuf_memLeft(b);
+    if (memLeft < n) {
+        /* Partially written binary data is useless, don't write anything */
+        return false;
+    }
+
+    if (b->buf || (n <= memLeftInElement)) {
+        ecs_os_memcpy(ecs_strbuf_ptr(b), data, n);
+        b->current->pos += n;
+    } else {
+        ecs_os_memcpy(ecs_strbuf_ptr(b), data, memLeftInElement);
+        b->current->pos += memLeftInElement;
+        data = ECS_OFFSET(data, memLeftInElement);
+        n -= memLeftInElement;
+
+        if (n <= ECS_STRBUF_ELEMENT_SIZE) {
+            ecs_strbuf_grow(b);
+            ecs_os_memcpy(ecs_strbuf_ptr(b), data, n);
+            b->current->pos += n;
+        } else {
+            char *remainder = ecs_os_malloc(n);
+            ecs_os_memcpy(remainder, data, n);
+            ecs_strbuf_grow_str(b, remainder, remainder, n);
+        }
+    }
+
+    return ecs_strbuf_memLeft(b) > 0;
+}
+
 static
 bool appendch(
     ecs_strbuf_t *b,
@@ -12625,6 +13661,16 @@ bool ecs_strbuf_appendstrn(
     return appendstr(b, str, len);
 }
 
+bool ecs_strbuf_appendbin(
+    ecs_strbuf_t *b,
+    const void* data,
+    int32_t n)
+{
+    ecs_assert(b != NULL, ECS_INVALID_PARAMETER, NULL);
+    ecs_assert(data != NULL || !n, ECS_INVALID_PARAMETER, NULL);
+    return appendbin(b, data, n);
+}
+
 bool ecs_strbuf_appendch(
     ecs_strbuf_t *b,
     char ch)
@@ -12639,7 +13685,36 @@ bool ecs_strbuf_appendflt(
     char nan_delim)
 {
     ecs_assert(b != NULL, ECS_INVALID_PARAMETER, NULL); 
-    return ecs_strbuf_ftoa(b, flt, 10, nan_delim);
+    return ecs_strbuf_ftoa(b, flt, false, nan_delim);
+}
+
+bool ecs_strbuf_appendflt32(
+    ecs_strbuf_t *b,
+    float flt,
+    char nan_delim)
+{
+    ecs_assert(b != NULL, ECS_INVALID_PARAMETER, NULL); 
+    return ecs_strbuf_ftoa(b, (double)flt, true, nan_delim);
+}
+
+bool ecs_strbuf_appendint(
+    ecs_strbuf_t *b,
+    int64_t v)
+{
+    ecs_assert(b != NULL, ECS_INVALID_PARAMETER, NULL); 
+    char buf[32];
+    char *ptr = strbuf_itoa(buf, v);
+    return ecs_strbuf_appendstrn(b, buf, (int32_t)(ptr - buf));
+}
+
+bool ecs_strbuf_appenduint(
+    ecs_strbuf_t *b,
+    uint64_t v)
+{
+    ecs_assert(b != NULL, ECS_INVALID_PARAMETER, NULL); 
+    char buf[32];
+    char *ptr = strbuf_utoa(buf, v);
+    return ecs_strbuf_appendstrn(b, buf, (int32_t)(ptr - buf));
 }
 
 bool ecs_strbuf_appendstr_zerocpy(
@@ -12744,6 +13819,18 @@ char* ecs_strbuf_get(
     return result;
 }
 
+void ecs_strbuf_flush(
+    ecs_strbuf_t *b)
+{
+    ecs_assert(b != NULL, ECS_INVALID_PARAMETER, NULL);
+    ecs_assert(b->flush != NULL, ECS_INVALID_OPERATION, NULL);
+    ecs_assert(b->buf == NULL, ECS_INVALID_OPERATION, NULL);
+
+    if (b->elementCount) {
+        ecs_strbuf_flush_current(b);
+    }
+}
+
 char *ecs_strbuf_get_small(
     ecs_strbuf_t *b)
 {
@@ -12857,67 +13944,27 @@ int32_t ecs_strbuf_written(
 
 #include <math.h>
 
-/* The ratio used to determine whether the map should rehash. If
- * (element_count * LOAD_FACTOR) > bucket_count, bucket count is increased. */
-#define LOAD_FACTOR (1.2f)
-#define KEY_SIZE (ECS_SIZEOF(ecs_map_key_t))
-#define GET_ELEM(array, elem_size, index) \
-    ECS_OFFSET(array, (elem_size) * (index))
-
-static 
-ecs_block_allocator_chunk_header_t *ecs_balloc_block(
-    ecs_block_allocator_t *allocator)
-{
-    ecs_block_allocator_chunk_header_t *first_chunk = 
-        ecs_os_malloc(allocator->block_size);
-    ecs_block_allocator_block_t *block = 
-        ecs_os_malloc_t(ecs_block_allocator_block_t);
-
-    block->memory = first_chunk;
-    if (!allocator->block_tail) {
-        ecs_assert(!allocator->block_head, ECS_INTERNAL_ERROR, 0);
-        block->next = NULL;
-        allocator->block_head = block;
-        allocator->block_tail = block;
-    } else {
-        block->next = NULL;
-        allocator->block_tail->next = block;
-        allocator->block_tail = block;
-    }
-
-    ecs_block_allocator_chunk_header_t *chunk = first_chunk;
-    int32_t i, end;
-    for (i = 0, end = allocator->chunks_per_block - 1; i < end; ++i) {
-        chunk->next = ECS_OFFSET(chunk, allocator->chunk_size);
-        chunk = chunk->next;
-    }
-
-    chunk->next = NULL;
-    return first_chunk;
-}
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define FLECS_MAP_SSE2
+#endif
 
-static 
-void *ecs_balloc(
-    ecs_block_allocator_t *allocator) 
-{
-    if (!allocator->head) {
-        allocator->head = ecs_balloc_block(allocator);
-    }
+/* Number of control bytes that is probed at once. The number of slots in a map
+ * is always a multiple of the group width, so groups never wrap around. */
+#define MAP_GROUP_WIDTH (16)
 
-    void *result = allocator->head;
-    allocator->head = allocator->head->next;
-    return result;
-}
+/* Control byte values. A slot that is in use stores the lower 7 bits of the key
+ * hash, which always has the high bit cleared. */
+#define MAP_CTRL_EMPTY ((uint8_t)0x80)
+#define MAP_CTRL_DELETED ((uint8_t)0xFE)
+#define MAP_CTRL_IS_FULL(c) (!((c) & 0x80))
 
-static 
-void ecs_bfree(
-    ecs_block_allocator_t *allocator, 
-    void *memory) 
-{
-    ecs_block_allocator_chunk_header_t *chunk = memory;
-    chunk->next = allocator->head;
-    allocator->head = chunk;
-}
+#define MAP_KEY_SIZE (ECS_SIZEOF(ecs_map_key_t))
+#define MAP_SLOT_KEY(map, index) \
+    ((map)->keys[index])
+#define MAP_SLOT_PAYLOAD(map, index) \
+    ECS_OFFSET((map)->payloads, (map)->payload_size * (index))
 
 static
 uint8_t ecs_log2(uint32_t v) {
@@ -12933,15 +13980,140 @@ uint8_t ecs_log2(uint32_t v) {
     return log2table[(uint32_t)(v * 0x07C4ACDDU) >> 27];
 }
 
-/* Get bucket count for number of elements */
+/* Index of the lowest set bit in a non-zero group mask */
+static
+int32_t map_ctz(
+    uint32_t v)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctz(v);
+#else
+    return ecs_log2(v & (~v + 1));
+#endif
+}
+
+/* Hash a key. The upper bits select the home slot of the key, 7 bits below the
+ * largest possible slot index are stored in the control byte. The high and
+ * low halves of the key are folded before multiplying, as pair ids only differ
+ * in a few bits of each half. Plain fibonacci hashing clusters those in a few
+ * groups, which makes probe sequences long when the map is almost full. */
+static
+uint64_t map_hash(
+    ecs_map_key_t key)
+{
+    return (key ^ (key >> 32)) * 11400714819323198485ull;
+}
+
+static
+uint8_t map_hash_tag(
+    uint64_t hash)
+{
+    return (uint8_t)((hash >> 25) & 0x7F);
+}
+
+#ifdef FLECS_MAP_SSE2
+
+/* Bitmask of slots in group with control byte equal to tag */
+static
+uint32_t map_group_match_tag(
+    const uint8_t *ctrl,
+    uint8_t tag)
+{
+    __m128i group = _mm_loadu_si128((const __m128i*)ctrl);
+    return (uint32_t)_mm_movemask_epi8(
+        _mm_cmpeq_epi8(group, _mm_set1_epi8((char)tag)));
+}
+
+/* Bitmask of slots in group that are empty */
+static
+uint32_t map_group_match_empty(
+    const uint8_t *ctrl)
+{
+    __m128i group = _mm_loadu_si128((const __m128i*)ctrl);
+    return (uint32_t)_mm_movemask_epi8(
+        _mm_cmpeq_epi8(group, _mm_set1_epi8((char)MAP_CTRL_EMPTY)));
+}
+
+/* Bitmask of slots in group that are empty or deleted */
+static
+uint32_t map_group_match_free(
+    const uint8_t *ctrl)
+{
+    return (uint32_t)_mm_movemask_epi8(
+        _mm_loadu_si128((const __m128i*)ctrl));
+}
+
+#else
+
+/* Portable fallback that tests 8 control bytes at a time */
+#define MAP_LSB (0x0101010101010101ull)
+#define MAP_MSB (0x8080808080808080ull)
+
+static
+uint64_t map_load_word(
+    const uint8_t *ctrl)
+{
+    /* Compilers turn this into a single load on little endian targets */
+    return (uint64_t)ctrl[0] | ((uint64_t)ctrl[1] << 8) | 
+        ((uint64_t)ctrl[2] << 16) | ((uint64_t)ctrl[3] << 24) | 
+        ((uint64_t)ctrl[4] << 32) | ((uint64_t)ctrl[5] << 40) | 
+        ((uint64_t)ctrl[6] << 48) | ((uint64_t)ctrl[7] << 56);
+}
+
+/* Convert word with the high bit set for matching bytes to a bit per byte */
+static
+uint32_t map_word_mask(
+    uint64_t word)
+{
+    return (uint32_t)(((word >> 7) * 0x0102040810204080ull) >> 56);
+}
+
+/* Bitmask of slots in group with control byte equal to tag. This can return
+ * false positives, which are filtered out by the key comparison. */
+static
+uint32_t map_group_match_tag(
+    const uint8_t *ctrl,
+    uint8_t tag)
+{
+    uint64_t lo = map_load_word(ctrl) ^ (MAP_LSB * tag);
+    uint64_t hi = map_load_word(&ctrl[8]) ^ (MAP_LSB * tag);
+    return map_word_mask((lo - MAP_LSB) & ~lo & MAP_MSB) |
+        (map_word_mask((hi - MAP_LSB) & ~hi & MAP_MSB) << 8);
+}
+
+/* Bitmask of slots in group that are empty. Only the empty control byte has 
+ * the high bit set and bit 1 cleared. */
+static
+uint32_t map_group_match_empty(
+    const uint8_t *ctrl)
+{
+    uint64_t lo = map_load_word(ctrl);
+    uint64_t hi = map_load_word(&ctrl[8]);
+    return map_word_mask(lo & ~(lo << 6) & MAP_MSB) |
+        (map_word_mask(hi & ~(hi << 6) & MAP_MSB) << 8);
+}
+
+/* Bitmask of slots in group that are empty or deleted */
+static
+uint32_t map_group_match_free(
+    const uint8_t *ctrl)
+{
+    return map_word_mask(map_load_word(ctrl) & MAP_MSB) |
+        (map_word_mask(map_load_word(&ctrl[8]) & MAP_MSB) << 8);
+}
+
+#endif
+
+/* Get slot count for number of elements */
 static
 int32_t get_bucket_count(
     int32_t element_count)
 {
-    return flecs_next_pow_of_2((int32_t)((float)element_count * LOAD_FACTOR));
+    int32_t count = flecs_next_pow_of_2(element_count + element_count / 7 + 1);
+    return ECS_MAX(count, MAP_GROUP_WIDTH);
 }
 
-/* Get bucket shift amount for a given bucket count */
+/* Get shift amount that maps a hash to a slot index */
 static
 uint8_t get_bucket_shift (
     int32_t bucket_count)
@@ -12949,172 +14121,192 @@ uint8_t get_bucket_shift (
     return (uint8_t)(64u - ecs_log2((uint32_t)bucket_count));
 }
 
-/* Get bucket index for provided map key */
+/* Get the home slot of a hash. Keys are stored in their home slot if it is
+ * free when they are inserted, which lets most lookups skip the group scan. */
 static
-int32_t get_bucket_index(
-    uint16_t bucket_shift,
-    ecs_map_key_t key) 
+int32_t map_home(
+    const ecs_map_t *map,
+    uint64_t hash)
 {
-    ecs_assert(bucket_shift != 0, ECS_INTERNAL_ERROR, NULL);
-    return (int32_t)((11400714819323198485ull * key) >> bucket_shift);
+    ecs_assert(map->bucket_shift == get_bucket_shift(map->bucket_count),
+        ECS_INTERNAL_ERROR, NULL);
+    return (int32_t)(hash >> map->bucket_shift);
 }
 
-/* Get bucket for key */
+/* Advance to the next group in the probe sequence. Strides increase by one
+ * group every step, which visits all groups as the group count is a power of
+ * 2. */
 static
-ecs_bucket_t* get_bucket(
+int32_t map_probe_next(
     const ecs_map_t *map,
-    ecs_map_key_t key)
+    int32_t pos,
+    int32_t *stride)
 {
-    ecs_assert(map->bucket_shift == get_bucket_shift(map->bucket_count),
-        ECS_INTERNAL_ERROR, NULL);
-    int32_t bucket_id = get_bucket_index(map->bucket_shift, key);
-    ecs_assert(bucket_id < map->bucket_count, ECS_INTERNAL_ERROR, NULL);
-    return &map->buckets[bucket_id];
+    *stride += MAP_GROUP_WIDTH;
+    return (pos + *stride) & (map->bucket_count - 1);
 }
 
-/* Ensure that map has at least new_count buckets */
+/* Find slot index for key by probing groups, or -1 if not in the map */
 static
-void ensure_buckets(
-    ecs_map_t *map,
-    int32_t new_count)
+int32_t map_find_probe(
+    const ecs_map_t *map,
+    ecs_map_key_t key,
+    uint64_t hash)
 {
-    int32_t bucket_count = map->bucket_count;
-    new_count = flecs_next_pow_of_2(new_count);
-    if (new_count < 2) {
-        new_count = 2;
-    }
+    uint8_t tag = map_hash_tag(hash);
+    int32_t pos = map_home(map, hash) & ~(MAP_GROUP_WIDTH - 1), stride = 0;
+
+    for (;;) {
+        const uint8_t *ctrl = &map->ctrl[pos];
+        uint32_t match = map_group_match_tag(ctrl, tag);
+        while (match) {
+            int32_t index = pos + map_ctz(match);
+            if (MAP_SLOT_KEY(map, index) == key) {
+                return index;
+            }
+            match &= match - 1;
+        }
 
-    if (new_count && new_count > bucket_count) {
-        map->buckets = ecs_os_realloc_n(map->buckets, ecs_bucket_t, new_count);
-        map->buckets_end = ECS_ELEM_T(map->buckets, ecs_bucket_t, new_count);
+        /* Keys are never stored past a group with an empty slot */
+        if (map_group_match_empty(ctrl)) {
+            return -1;
+        }
 
-        map->bucket_count = new_count;
-        map->bucket_shift = get_bucket_shift(new_count);
-        ecs_os_memset_n(ECS_ELEM_T(map->buckets, ecs_bucket_t, bucket_count),
-            0, ecs_bucket_t, (new_count - bucket_count));
+        pos = map_probe_next(map, pos, &stride);
     }
 }
 
-/* Free contents of bucket */
+/* Find slot index for key, or -1 if the key is not in the map. Keys in their
+ * home slot are found with two loads that don't depend on each other, which
+ * is cheaper than scanning the group for the tag first. */
 static
-void clear_bucket(
-    ecs_block_allocator_t *allocator,
-    ecs_bucket_entry_t *bucket)
+int32_t map_find(
+    const ecs_map_t *map,
+    ecs_map_key_t key)
 {
-    while(bucket) {
-      ecs_bucket_entry_t *next = bucket->next;
-      ecs_bfree(allocator, bucket);
-      bucket = next;
+    uint64_t hash = map_hash(key);
+    int32_t home = map_home(map, hash);
+    if (map->ctrl[home] == map_hash_tag(hash) && 
+        MAP_SLOT_KEY(map, home) == key) 
+    {
+        return home;
     }
+
+    return map_find_probe(map, key, hash);
 }
 
-/* Clear all buckets */
+/* Find empty or deleted slot for key that is not in the map */
 static
-void clear_buckets(
-    ecs_map_t *map)
+int32_t map_find_free(
+    const ecs_map_t *map,
+    uint64_t hash)
 {
-    int32_t i, count = map->bucket_count;
-    for (i = 0; i < count; i ++) {
-        clear_bucket(&map->allocator, map->buckets[i].first);
+    int32_t home = map_home(map, hash);
+    if (!MAP_CTRL_IS_FULL(map->ctrl[home])) {
+        return home;
     }
-    ecs_os_free(map->buckets);
-    map->buckets = NULL;
-    map->bucket_count = 0;
-}
 
-/* Add element to bucket */
-static
-void* add_to_bucket(
-    ecs_block_allocator_t *allocator,
-    ecs_bucket_t *bucket,
-    ecs_size_t elem_size,
-    ecs_map_key_t key,
-    const void *payload)
-{
-    ecs_bucket_entry_t *new_entry = ecs_balloc(allocator);
-    new_entry->key = key;
-    new_entry->next = bucket->first;
-    bucket->first = new_entry;
-    void *new_payload = ECS_OFFSET(&new_entry->key, ECS_SIZEOF(ecs_map_key_t));
-    if (elem_size && payload) {
-        ecs_os_memcpy(new_payload, payload, elem_size);
+    int32_t pos = home & ~(MAP_GROUP_WIDTH - 1), stride = 0;
+
+    for (;;) {
+        uint32_t match = map_group_match_free(&map->ctrl[pos]);
+        if (match) {
+            return pos + map_ctz(match);
+        }
+
+        pos = map_probe_next(map, pos, &stride);
     }
-    return new_payload;
 }
 
-/*  Remove element from bucket */
+/* Allocate slots and control bytes for bucket_count slots */
 static
-bool remove_from_bucket(
-    ecs_block_allocator_t *allocator,
-    ecs_bucket_t *bucket,
-    ecs_map_key_t key)
+void map_alloc(
+    ecs_map_t *map,
+    int32_t bucket_count)
 {
-    ecs_bucket_entry_t *entry;
-    for (entry = bucket->first; entry; entry = entry->next) {
-        if (entry->key == key) {
-            ecs_bucket_entry_t **next_holder = &bucket->first;
-            while(*next_holder != entry) {
-                next_holder = &(*next_holder)->next;
-            }
-            *next_holder = entry->next;
-            ecs_bfree(allocator, entry);
-            return true;
-        }
-    }
-    
-    return false;
+    ecs_assert(bucket_count >= MAP_GROUP_WIDTH, ECS_INTERNAL_ERROR, NULL);
+    ecs_assert(!(bucket_count & (bucket_count - 1)), ECS_INTERNAL_ERROR, NULL);
+
+    ecs_size_t slots_size = (map->payload_size + MAP_KEY_SIZE) * bucket_count;
+    map->keys = ecs_os_malloc(slots_size + bucket_count);
+    ecs_assert(map->keys != NULL, ECS_OUT_OF_MEMORY, NULL);
+    map->payloads = &map->keys[bucket_count];
+    map->ctrl = ECS_OFFSET(map->keys, slots_size);
+    ecs_os_memset(map->ctrl, MAP_CTRL_EMPTY, bucket_count);
+    map->bucket_count = bucket_count;
+    map->bucket_shift = get_bucket_shift(bucket_count);
+    map->growth_left = bucket_count - bucket_count / 8;
 }
 
-/* Get payload pointer for key from bucket */
+/* Store key in free slot, return payload */
 static
-void* get_from_bucket(
-    ecs_bucket_t *bucket,
-    ecs_map_key_t key)
+void* map_insert(
+    ecs_map_t *map,
+    ecs_map_key_t key,
+    uint64_t hash,
+    int32_t index)
 {
-    ecs_bucket_entry_t *entry;
-    for (entry = bucket->first; entry; entry = entry->next) {
-        if (entry->key == key) {
-            return ECS_OFFSET(&entry->key, ECS_SIZEOF(ecs_map_key_t));
-        }
+    if (map->ctrl[index] == MAP_CTRL_EMPTY) {
+        map->growth_left --;
     }
-    
-    return NULL;
+    map->ctrl[index] = map_hash_tag(hash);
+    MAP_SLOT_KEY(map, index) = key;
+    return MAP_SLOT_PAYLOAD(map, index);
 }
 
-/* Grow number of buckets */
+/* Move elements to a new slot array with bucket_count slots. This also drops
+ * all tombstones. */
 static
 void rehash(
     ecs_map_t *map,
     int32_t bucket_count)
 {
     ecs_assert(bucket_count != 0, ECS_INTERNAL_ERROR, NULL);
-    ecs_assert(bucket_count > map->bucket_count, ECS_INTERNAL_ERROR, NULL);
-    
+    ecs_assert(bucket_count - bucket_count / 8 >= map->count, 
+        ECS_INTERNAL_ERROR, NULL);
+
+    uint8_t *old_ctrl = map->ctrl;
+    ecs_map_key_t *old_keys = map->keys;
+    void *old_payloads = map->payloads;
     int32_t old_count = map->bucket_count;
-    ecs_bucket_t *old_buckets = map->buckets;
-    
-    int32_t new_count = flecs_next_pow_of_2(bucket_count);
-    map->bucket_count = new_count;
-    map->bucket_shift = get_bucket_shift(new_count);
-    map->buckets = ecs_os_calloc_n(ecs_bucket_t, new_count);
-    map->buckets_end = ECS_ELEM_T(map->buckets, ecs_bucket_t, new_count);
-    
-    /* Remap old bucket entries to new buckets */
+    ecs_size_t payload_size = map->payload_size;
+
+    map_alloc(map, bucket_count);
+
     int32_t index;
-    for (index = 0; index < old_count; ++index) {
-        ecs_bucket_entry_t* entry;
-        for (entry = old_buckets[index].first; entry;) {
-            ecs_bucket_entry_t* next = entry->next;
-            int32_t bucket_index = get_bucket_index(
-                map->bucket_shift, entry->key);
-            ecs_bucket_t *bucket = &map->buckets[bucket_index];
-            entry->next = bucket->first;
-            bucket->first = entry;
-            entry = next;
+    for (index = 0; index < old_count; index ++) {
+        if (!MAP_CTRL_IS_FULL(old_ctrl[index])) {
+            continue;
         }
+
+        void *slot = ECS_OFFSET(old_payloads, payload_size * index);
+        ecs_map_key_t key = old_keys[index];
+        uint64_t hash = map_hash(key);
+        int32_t new_index = map_find_free(map, hash);
+        void *payload = map_insert(map, key, hash, new_index);
+        ecs_os_memcpy(payload, slot, payload_size);
     }
-    
-    ecs_os_free(old_buckets);
+
+    ecs_os_free(old_keys);
+}
+
+/* Make room for one more element */
+static
+void map_reserve_one(
+    ecs_map_t *map)
+{
+    if (map->growth_left > 0) {
+        return;
+    }
+
+    /* If most of the used slots are tombstones, rehashing without growing is
+     * enough to free up slots */
+    int32_t bucket_count = map->bucket_count;
+    if (map->count >= (bucket_count - bucket_count / 8) / 2) {
+        bucket_count *= 2;
+    }
+
+    rehash(map, bucket_count);
 }
 
 void _ecs_map_init(
@@ -13122,29 +14314,16 @@ void _ecs_map_init(
     ecs_size_t elem_size,
     int32_t element_count)
 {
-    ecs_assert(elem_size < INT16_MAX, ECS_INVALID_PARAMETER, NULL);
+    ecs_assert(elem_size < INT16_MAX - MAP_KEY_SIZE, 
+        ECS_INVALID_PARAMETER, NULL);
 
     result->count = 0;
     result->elem_size = (int16_t)elem_size;
-    
-    int32_t entry_size = elem_size + ECS_SIZEOF(ecs_bucket_entry_t);
-    int32_t balloc_min_chunk_size = ECS_MAX(entry_size, 
-        ECS_SIZEOF(ecs_block_allocator_chunk_header_t));
-    uint32_t alignment = 16;
-    uint32_t alignment_mask = alignment - 1u;
-
-    /* Align balloc_min_chunk_size up to alignment. */
-    result->allocator.chunk_size = (int32_t)(((uint32_t)balloc_min_chunk_size + 
-        alignment_mask) & ~alignment_mask);
-    result->allocator.chunks_per_block = 
-        ECS_MAX(4096 / result->allocator.chunk_size, 1);
-    result->allocator.block_size = result->allocator.chunks_per_block * 
-        result->allocator.chunk_size;
-    result->allocator.head = NULL;
-    result->allocator.block_head = NULL;
-    result->allocator.block_tail = NULL;
-
-    ensure_buckets(result, get_bucket_count(element_count));
+
+    /* Keep payloads 8 byte aligned */
+    result->payload_size = (int16_t)ECS_ALIGN(elem_size, 8);
+
+    map_alloc(result, get_bucket_count(element_count));
 }
 
 ecs_map_t* _ecs_map_new(
@@ -13169,18 +14348,13 @@ void ecs_map_fini(
     ecs_map_t *map)
 {
     ecs_assert(map != NULL, ECS_INTERNAL_ERROR, NULL);
-    ecs_block_allocator_block_t *block;
-    for (block = map->allocator.block_head; block; ){
-        ecs_block_allocator_block_t *next = block->next;
-        ecs_os_free(block->memory);
-        ecs_os_free(block);
-        block = next;
-    }
-    map->allocator.block_head = NULL;
-    ecs_os_free(map->buckets);
-    map->buckets = NULL;
-    map->buckets_end = NULL;
+    ecs_os_free(map->keys);
+    map->keys = NULL;
+    map->payloads = NULL;
+    map->ctrl = NULL;
     map->bucket_count = 0;
+    map->count = 0;
+    map->growth_left = 0;
     ecs_assert(!ecs_map_is_initialized(map), ECS_INTERNAL_ERROR, NULL);
 }
 
@@ -13206,9 +14380,20 @@ void* _ecs_map_get(
 
     ecs_assert(elem_size == map->elem_size, ECS_INVALID_PARAMETER, NULL);
 
-    ecs_bucket_t *bucket = get_bucket(map, key);
+    /* Same as map_find, repeated here so the home slot check isn't behind a
+     * function call on the most frequently used lookup path. */
+    uint64_t hash = map_hash(key);
+    int32_t index = map_home(map, hash);
+    if (map->ctrl[index] != map_hash_tag(hash) || 
+        MAP_SLOT_KEY(map, index) != key) 
+    {
+        index = map_find_probe(map, key, hash);
+        if (index == -1) {
+            return NULL;
+        }
+    }
 
-    return get_from_bucket(bucket, key);
+    return MAP_SLOT_PAYLOAD(map, index);
 }
 
 void* _ecs_map_get_ptr(
@@ -13232,9 +14417,7 @@ bool ecs_map_has(
         return false;
     }
 
-    ecs_bucket_t *bucket = get_bucket(map, key);
-
-    return get_from_bucket(bucket, key) != NULL;
+    return map_find(map, key) != -1;
 }
 
 void* _ecs_map_ensure(
@@ -13242,13 +14425,25 @@ void* _ecs_map_ensure(
     ecs_size_t elem_size,
     ecs_map_key_t key)
 {
-    void *result = _ecs_map_get(map, elem_size, key);
-    if (!result) {
-        result = _ecs_map_set(map, elem_size, key, NULL);
-        if (elem_size) {
-            ecs_assert(result != NULL, ECS_INTERNAL_ERROR, NULL);
-            ecs_os_memset(result, 0, elem_size);
-        }
+    ecs_assert(map != NULL, ECS_INVALID_PARAMETER, NULL);
+    ecs_assert(elem_size == map->elem_size, ECS_INVALID_PARAMETER, NULL);
+
+    if (!ecs_map_is_initialized(map)) {
+        /* Map was initialized with ECS_MAP_INIT */
+        _ecs_map_init(map, elem_size, 0);
+    }
+
+    int32_t index = map_find(map, key);
+    if (index != -1) {
+        return MAP_SLOT_PAYLOAD(map, index);
+    }
+
+    map_reserve_one(map);
+    uint64_t hash = map_hash(key);
+    void *result = map_insert(map, key, hash, map_find_free(map, hash));
+    map->count ++;
+    if (elem_size) {
+        ecs_os_memset(result, 0, elem_size);
     }
 
     return result;
@@ -13263,29 +14458,27 @@ void* _ecs_map_set(
     ecs_assert(map != NULL, ECS_INVALID_PARAMETER, NULL);
     ecs_assert(elem_size == map->elem_size, ECS_INVALID_PARAMETER, NULL);
 
-    ecs_bucket_t *bucket = get_bucket(map, key);
-
-    void *elem = get_from_bucket(bucket, key);
-    if (!elem) {
-        void *added_data = add_to_bucket(
-            &map->allocator, bucket, elem_size, key, payload);
-        int32_t map_count = ++map->count;
-        int32_t target_bucket_count = get_bucket_count(map_count);
-        int32_t map_bucket_count = map->bucket_count;
+    if (!ecs_map_is_initialized(map)) {
+        /* Map was initialized with ECS_MAP_INIT */
+        _ecs_map_init(map, elem_size, 0);
+    }
 
-        if (target_bucket_count > map_bucket_count) {
-            rehash(map, target_bucket_count);
-            bucket = get_bucket(map, key);
-            added_data = get_from_bucket(bucket, key);
-            ecs_assert(added_data != NULL, ECS_INVALID_PARAMETER, NULL);
-        }
-        return added_data;
+    void *elem;
+    int32_t index = map_find(map, key);
+    if (index == -1) {
+        map_reserve_one(map);
+        uint64_t hash = map_hash(key);
+        elem = map_insert(map, key, hash, map_find_free(map, hash));
+        map->count ++;
     } else {
-        if (payload) {
-            ecs_os_memcpy(elem, payload, elem_size);
-        }
-        return elem;
+        elem = MAP_SLOT_PAYLOAD(map, index);
+    }
+
+    if (payload && elem_size) {
+        ecs_os_memcpy(elem, payload, elem_size);
     }
+
+    return elem;
 }
 
 int32_t ecs_map_remove(
@@ -13294,12 +14487,27 @@ int32_t ecs_map_remove(
 {
     ecs_assert(map != NULL, ECS_INVALID_PARAMETER, NULL);
 
-    ecs_bucket_t *bucket = get_bucket(map, key);
-    if (remove_from_bucket(&map->allocator, bucket, key)) {
-        return --map->count;
+    if (!ecs_map_is_initialized(map)) {
+        return 0;
     }
-    
-    return map->count;
+
+    int32_t index = map_find(map, key);
+    if (index == -1) {
+        return map->count;
+    }
+
+    /* A probe only passes the group of this slot if the group has no empty
+     * slots. If it has, the slot can be made empty, otherwise leave a tombstone
+     * so that probes for other keys continue to the next group. */
+    uint8_t *group = &map->ctrl[index & ~(MAP_GROUP_WIDTH - 1)];
+    if (map_group_match_empty(group)) {
+        map->ctrl[index] = MAP_CTRL_EMPTY;
+        map->growth_left ++;
+    } else {
+        map->ctrl[index] = MAP_CTRL_DELETED;
+    }
+
+    return --map->count;
 }
 
 int32_t ecs_map_count(
@@ -13318,9 +14526,8 @@ void ecs_map_clear(
     ecs_map_t *map)
 {
     ecs_assert(map != NULL, ECS_INVALID_PARAMETER, NULL);
-    clear_buckets(map);
-    map->count = 0;
-    ensure_buckets(map, 2);
+    ecs_os_free(map->keys);
+    _ecs_map_init(map, map->elem_size, 0);
 }
 
 ecs_map_iter_t ecs_map_iter(
@@ -13328,8 +14535,7 @@ ecs_map_iter_t ecs_map_iter(
 {
     return (ecs_map_iter_t){
         .map = map,
-        .bucket = NULL,
-        .entry = NULL
+        .index = 0
     };
 }
 
@@ -13343,46 +14549,28 @@ void* _ecs_map_next(
     if (!ecs_map_is_initialized(map)) {
         return NULL;
     }
-    if (iter->bucket == map->buckets_end) {
-        return NULL;
-    }
 
     ecs_assert(!elem_size || elem_size == map->elem_size, 
         ECS_INVALID_PARAMETER, NULL);
 
-    ecs_bucket_entry_t *entry = NULL;
-    
-    if (!iter->bucket) {
-        for (iter->bucket = map->buckets; 
-            iter->bucket != map->buckets_end; 
-            ++iter->bucket) 
-        {
-            if (iter->bucket->first) {
-                entry = iter->bucket->first;
-                break;
-            }
-        }
-        if (iter->bucket == map->buckets_end) {
-            return NULL;
-        }
-    } else if ((entry = iter->entry) == NULL) {
-        do {
-            ++iter->bucket;
-            if (iter->bucket == map->buckets_end) {
-                return NULL;
-            }
-        } while(!iter->bucket->first);
-        entry = iter->bucket->first;
+    int32_t index = iter->index, count = map->bucket_count;
+    const uint8_t *ctrl = map->ctrl;
+    while (index < count && !MAP_CTRL_IS_FULL(ctrl[index])) {
+        index ++;
     }
-    
-    if (key_out) {
-        ecs_assert(entry != NULL, ECS_INTERNAL_ERROR, NULL);
-        *key_out = entry->key;
+
+    if (index >= count) {
+        iter->index = count;
+        return NULL;
     }
 
-    iter->entry = entry->next;
+    iter->index = index + 1;
+
+    if (key_out) {
+        *key_out = MAP_SLOT_KEY(map, index);
+    }
 
-    return ECS_OFFSET(&entry->key, ECS_SIZEOF(ecs_map_key_t));
+    return MAP_SLOT_PAYLOAD(map, index);
 }
 
 void* _ecs_map_next_ptr(
@@ -13405,7 +14593,9 @@ void ecs_map_grow(
     int32_t target_count = map->count + element_count;
     int32_t bucket_count = get_bucket_count(target_count);
 
-    if (bucket_count > map->bucket_count) {
+    if (!ecs_map_is_initialized(map)) {
+        _ecs_map_init(map, map->elem_size, target_count);
+    } else if (bucket_count > map->bucket_count) {
         rehash(map, bucket_count);
     }
 }
@@ -13415,9 +14605,12 @@ void ecs_map_set_size(
     int32_t element_count)
 {    
     ecs_assert(map != NULL, ECS_INVALID_PARAMETER, NULL);
-    int32_t bucket_count = get_bucket_count(element_count);
+    int32_t bucket_count = get_bucket_count(
+        ECS_MAX(element_count, map->count));
 
-    if (bucket_count) {
+    if (!ecs_map_is_initialized(map)) {
+        _ecs_map_init(map, map->elem_size, element_count);
+    } else if (bucket_count != map->bucket_count) {
         rehash(map, bucket_count);
     }
 }
@@ -13429,15 +14622,14 @@ ecs_map_t* ecs_map_copy(
         return NULL;
     }
 
-    ecs_size_t elem_size = map->elem_size;
-    ecs_map_t *result = _ecs_map_new(map->elem_size, ecs_map_count(map));
-
-    ecs_map_iter_t it = ecs_map_iter(map);
-    ecs_map_key_t key;
-    void *ptr;
-    while ((ptr = _ecs_map_next(&it, elem_size, &key))) {
-        _ecs_map_set(result, elem_size, key, ptr);
-    }
+    /* Slots and control bytes can be copied as is, including tombstones */
+    ecs_map_t *result = ecs_os_memdup_t(map, ecs_map_t);
+    int32_t count = map->bucket_count;
+    ecs_size_t size = (map->payload_size + MAP_KEY_SIZE + 1) * count;
+    result->keys = ecs_os_memdup(map->keys, size);
+    result->payloads = &result->keys[count];
+    result->ctrl = ECS_OFFSET(result->keys, 
+        (map->payload_size + MAP_KEY_SIZE) * count);
 
     return result;
 }
@@ -13453,22 +14645,12 @@ void ecs_map_memory(
         *used = map->count * map->elem_size;
     }
 
-    // TODO: something something block allocator
     if (allocd) {
         *allocd += ECS_SIZEOF(ecs_map_t);
-        *allocd += ECS_SIZEOF(ecs_bucket_entry_t*) * map->bucket_count;
-        int32_t index;
-        int32_t entry_size = map->elem_size + ECS_SIZEOF(ecs_bucket_entry_t);
-        for (index = 0; index < map->bucket_count; ++index) {
-            ecs_bucket_entry_t *entry;
-            for (entry = map->buckets[index].first; entry; entry = entry->next){
-                *allocd += entry_size;
-            }
-        }
+        *allocd += (map->payload_size + MAP_KEY_SIZE + 1) * map->bucket_count;
     }
 }
 
-
 static
 int32_t find_key(
     const ecs_hashmap_t *map,
@@ -14244,6 +15426,8 @@ typedef struct EcsSystem {
     /* Schedule parameters */
     bool multi_threaded;
     bool no_staging;
+    bool concurrent;
+    int32_t lane;                   /* Worker lane for single threaded systems */
 
     int32_t invoke_count;           /* Number of times system is invoked */
     float time_spent;               /* Time spent on running system */
@@ -14300,13 +15484,26 @@ typedef struct ecs_pipeline_op_t {
     bool no_staging;            /* Whether systems are staged or not */
 } ecs_pipeline_op_t;
 
+/** Schedule of a single phase. When a pipeline is rebuilt, phases for which
+ * the active systems didn't change reuse their schedule. */
+typedef struct ecs_pipeline_phase_t {
+    uint64_t id;                /* Group id of the phase in the pipeline query */
+    ecs_vector_t *systems;      /* Active systems in declaration order */
+    ecs_vector_t *order;        /* Indices into systems in the order they run */
+    bool no_staging;            /* Staging mode at the start of the phase */
+} ecs_pipeline_phase_t;
+
 typedef struct EcsPipelineQuery {
     ecs_query_t *query;
     ecs_query_t *build_query;
     ecs_vector_t *ops;
+    ecs_vector_t *systems;      /* Active systems in the order they're ran */
+    ecs_vector_t *phases;       /* Schedules of phases from the last build */
+    ecs_map_t *write_state;     /* Component write state used while building */
     int32_t match_count;
+    int32_t stage_count;        /* Number of stages lanes were assigned for */
     int32_t rebuild_count;
-    ecs_entity_t last_system;
+    int32_t ran_count;          /* Systems ran before a rebuild during a frame */
 } EcsPipelineQuery;
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -14339,7 +15536,6 @@ bool ecs_pipeline_update(
 int32_t ecs_pipeline_reset_iter(
     ecs_world_t *world,
     const EcsPipelineQuery *pq,
-    ecs_iter_t *iter_out,
     ecs_pipeline_op_t **op_out,
     ecs_pipeline_op_t **last_op_out);
 
@@ -14352,8 +15548,7 @@ void ecs_worker_begin(
 
 int32_t ecs_worker_sync(
     ecs_world_t *world,
-    const EcsPipelineQuery *pq,
-    ecs_iter_t *it,
+    const EcsPipelineQuery **pq,
     int32_t i,
     ecs_pipeline_op_t **op_out,
     ecs_pipeline_op_t **last_op_out);
@@ -14560,8 +15755,7 @@ void ecs_worker_begin(
 
 int32_t ecs_worker_sync(
     ecs_world_t *world,
-    const EcsPipelineQuery *pq,
-    ecs_iter_t *it,
+    const EcsPipelineQuery **pq,
     int32_t i,
     ecs_pipeline_op_t **op_out,
     ecs_pipeline_op_t **last_op_out)
@@ -14585,7 +15779,9 @@ int32_t ecs_worker_sync(
     }
 
     if (build_count != world->info.pipeline_build_count_total) {
-        i = ecs_pipeline_reset_iter(world, pq, it, op_out, last_op_out);
+        /* Refetch, in case pipeline itself has moved */
+        *pq = ecs_get(world, world->pipeline, EcsPipelineQuery);
+        i = ecs_pipeline_reset_iter(world, *pq, op_out, last_op_out);
     } else {
         op_out[0] ++;
     }
@@ -14673,8 +15869,7 @@ void ecs_workers_progress(
                 pq = ecs_get(world, pipeline, EcsPipelineQuery);
 
                 /* Pipeline has changed, reset position in pipeline */
-                ecs_iter_t it;
-                ecs_pipeline_reset_iter(world, pq, &it, &op, &op_last);
+                ecs_pipeline_reset_iter(world, pq, &op, &op_last);
                 op --;
             }
         }
@@ -14720,8 +15915,27 @@ void ecs_set_threads(
 
 #ifdef FLECS_PIPELINE
 
+static
+void free_phases(
+    ecs_vector_t *phases)
+{
+    ecs_pipeline_phase_t *phase = ecs_vector_first(
+        phases, ecs_pipeline_phase_t);
+    int32_t i, count = ecs_vector_count(phases);
+
+    for (i = 0; i < count; i ++) {
+        ecs_vector_free(phase[i].systems);
+        ecs_vector_free(phase[i].order);
+    }
+
+    ecs_vector_free(phases);
+}
+
 static ECS_DTOR(EcsPipelineQuery, ptr, {
     ecs_vector_free(ptr->ops);
+    ecs_vector_free(ptr->systems);
+    free_phases(ptr->phases);
+    ecs_map_free(ptr->write_state);
 })
 
 static
@@ -14970,178 +16184,690 @@ bool check_terms(
     return needs_merge;
 }
 
+/* Component access of a single system, used to find systems that can run in
+ * parallel within a pipeline op, and systems that can be reordered. */
+typedef struct system_access_t {
+    ecs_id_t id;
+    bool write;
+} system_access_t;
+
+typedef struct lane_state_t {
+    EcsSystem *sys;
+    int32_t access_first;
+    int32_t access_count;
+    int32_t parent;
+    int32_t lane;
+    bool exclusive;
+} lane_state_t;
+
+/* System in the schedule of a pipeline while it is being built */
+typedef struct schedule_elem_t {
+    ecs_entity_t entity;
+    EcsSystem *sys;
+    uint64_t phase;
+    int32_t index;              /* Index in active systems */
+    int32_t access_first;       /* -1 if access hasn't been computed yet */
+    int32_t access_count;
+    bool exclusive;
+    bool scheduled;
+} schedule_elem_t;
+
+/* Cases of a union relation are stored in a single column, so accessing one
+ * case accesses all of them. */
+static
+ecs_id_t get_access_id(
+    const ecs_world_t *world,
+    ecs_id_t id)
+{
+    if (ECS_HAS_ROLE(id, PAIR)) {
+        ecs_id_t wc = ecs_pair(ECS_PAIR_FIRST(id), EcsWildcard);
+        ecs_id_record_t *idr = flecs_get_id_record(world, wc);
+        if (idr && (idr->flags & EcsIdUnion)) {
+            return wc;
+        }
+    }
+
+    return id;
+}
+
+/* Add the components a system reads or writes to the access vector. Tags,
+ * filter and Not terms are included, as changing them changes which entities a
+ * system matches. Returns false if the access of the system cannot be derived
+ * from its query, in which case the system must not run at the same time as or
+ * be reordered with other systems. Only concurrent systems promise to not use
+ * data outside of their query. A no_staging system is never limited to its
+ * query, as it can use other queries or get components without going through
+ * a stage. */
+static
+bool get_system_access(
+    const ecs_world_t *world,
+    const EcsSystem *sys,
+    ecs_vector_t **access)
+{
+    if (sys->run || sys->no_staging || !sys->concurrent) {
+        return false;
+    }
+
+    ecs_filter_t *filter = &sys->query->filter;
+    ecs_term_t *terms = filter->terms;
+    int32_t t, term_count = filter->term_count;
+    if (!term_count) {
+        return false;
+    }
+
+    for (t = 0; t < term_count; t ++) {
+        ecs_term_t *term = &terms[t];
+        ecs_term_id_t *subj = &term->subj;
+        bool is_tag = ecs_id_is_tag(world, term->id);
+        bool write;
+        if (term->oper == EcsNot) {
+            /* A Not term usually means the system adds the component */
+            write = true;
+        } else {
+            switch(term->inout) {
+            case EcsIn:
+            case EcsInOutFilter:
+                write = false;
+                break;
+            case EcsInOutDefault:
+                /* Default inout behavior is [inout] for This terms, and [in]
+                 * for terms that match other entities */
+                write = !is_tag && (
+                    ((subj->set.mask & EcsSelf) && (subj->entity == EcsThis)) ||
+                    (subj->set.mask == EcsNothing));
+                break;
+            default:
+                write = true;
+                break;
+            }
+        }
+
+        system_access_t *elem = ecs_vector_add(access, system_access_t);
+        elem->id = get_access_id(world, term->id);
+        elem->write = write;
+    }
+
+    return true;
+}
+
+static
+bool access_conflicts(
+    const system_access_t *a,
+    int32_t a_count,
+    const system_access_t *b,
+    int32_t b_count)
+{
+    int32_t i, j;
+    for (i = 0; i < a_count; i ++) {
+        for (j = 0; j < b_count; j ++) {
+            if (!a[i].write && !b[j].write) {
+                continue;
+            }
+            if (ecs_id_match(a[i].id, b[j].id) ||
+                ecs_id_match(b[j].id, a[i].id))
+            {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+static
+bool elems_conflict(
+    const schedule_elem_t *a,
+    const schedule_elem_t *b,
+    const system_access_t *access)
+{
+    if (a->exclusive || b->exclusive) {
+        return true;
+    }
+
+    return access_conflicts(
+        &access[a->access_first], a->access_count,
+        &access[b->access_first], b->access_count);
+}
+
+static
+int32_t lane_find(
+    lane_state_t *state,
+    int32_t i)
+{
+    while (state[i].parent != i) {
+        state[i].parent = state[state[i].parent].parent;
+        i = state[i].parent;
+    }
+    return i;
+}
+
+static
+void lane_union(
+    lane_state_t *state,
+    int32_t a,
+    int32_t b)
+{
+    a = lane_find(state, a);
+    b = lane_find(state, b);
+
+    /* Keep the earliest system as root, so lanes are numbered in order */
+    if (a < b) {
+        state[b].parent = a;
+    } else if (b < a) {
+        state[a].parent = b;
+    }
+}
+
+/* Assign worker lanes to the single threaded systems of a staged op. Systems
+ * that (transitively) access the same data with at least one of them writing
+ * end up in the same lane, and run in pipeline order on the same worker.
+ * Systems in different lanes don't depend on each other, and are distributed
+ * across workers so they can run at the same time. Systems that aren't 
+ * concurrent are exclusive, and share a lane with all systems in the op. */
+static
+void assign_lanes(
+    ecs_world_t *world,
+    ecs_vector_t *systems,
+    ecs_vector_t **access)
+{
+    lane_state_t *state = ecs_vector_first(systems, lane_state_t);
+    int32_t i, j, count = ecs_vector_count(systems);
+
+    ecs_vector_clear(*access);
+    for (i = 0; i < count; i ++) {
+        state[i].access_first = ecs_vector_count(*access);
+        state[i].exclusive = !get_system_access(world, state[i].sys, access);
+        state[i].access_count =
+            ecs_vector_count(*access) - state[i].access_first;
+        state[i].parent = i;
+        state[i].lane = -1;
+    }
+
+    system_access_t *elems = ecs_vector_first(*access, system_access_t);
+    for (i = 0; i < count; i ++) {
+        for (j = i + 1; j < count; j ++) {
+            if (lane_find(state, i) == lane_find(state, j)) {
+                continue;
+            }
+
+            if (state[i].exclusive || state[j].exclusive || access_conflicts(
+                &elems[state[i].access_first], state[i].access_count,
+                &elems[state[j].access_first], state[j].access_count))
+            {
+                lane_union(state, i, j);
+            }
+        }
+    }
+
+    int32_t lane_count = 0;
+    for (i = 0; i < count; i ++) {
+        int32_t root = lane_find(state, i);
+        if (state[root].lane == -1) {
+            state[root].lane = lane_count ++;
+        }
+        state[i].sys->lane = state[root].lane;
+    }
+}
+
+/* Assign lanes to the single threaded systems of each staged op */
+static
+void build_lanes(
+    ecs_world_t *world,
+    schedule_elem_t *elems,
+    ecs_vector_t *ops)
+{
+    ecs_pipeline_op_t *op = ecs_vector_first(ops, ecs_pipeline_op_t);
+    int32_t o, op_count = ecs_vector_count(ops);
+    ecs_vector_t *systems = NULL, *access = NULL;
+    int32_t i, cur = 0;
+
+    for (o = 0; o < op_count; o ++) {
+        ecs_vector_clear(systems);
+
+        for (i = cur; i < cur + op[o].count; i ++) {
+            EcsSystem *sys = elems[i].sys;
+            sys->lane = 0;
+            if (!op[o].no_staging && !sys->multi_threaded) {
+                lane_state_t *elem = ecs_vector_add(&systems, lane_state_t);
+                elem->sys = sys;
+            }
+        }
+
+        assign_lanes(world, systems, &access);
+        cur += op[o].count;
+    }
+
+    ecs_vector_free(systems);
+    ecs_vector_free(access);
+}
+
+/* Compute the access of a system in the schedule if not yet known. Access is
+ * only needed when a phase is reordered or single and multi threaded systems
+ * are mixed, so it is computed on demand. */
+static
+void ensure_access(
+    const ecs_world_t *world,
+    schedule_elem_t *elem,
+    ecs_vector_t **access)
+{
+    if (elem->access_first != -1) {
+        return;
+    }
+
+    elem->access_first = ecs_vector_count(*access);
+    elem->exclusive = !get_system_access(world, elem->sys, access);
+    elem->access_count = ecs_vector_count(*access) - elem->access_first;
+}
+
+/* Find the schedule of a phase from the last build. Returns NULL if the
+ * active systems in the phase or the staging mode it starts in changed. */
+static
+ecs_pipeline_phase_t* find_phase(
+    ecs_vector_t *phases,
+    const schedule_elem_t *elems,
+    int32_t count,
+    bool no_staging)
+{
+    ecs_pipeline_phase_t *phase = ecs_vector_first(
+        phases, ecs_pipeline_phase_t);
+    int32_t i, j, phase_count = ecs_vector_count(phases);
+
+    for (i = 0; i < phase_count; i ++) {
+        if (phase[i].id != elems[0].phase) {
+            continue;
+        }
+
+        if (phase[i].no_staging != no_staging) {
+            return NULL;
+        }
+
+        if (ecs_vector_count(phase[i].systems) != count) {
+            return NULL;
+        }
+
+        ecs_entity_t *systems = ecs_vector_first(
+            phase[i].systems, ecs_entity_t);
+        for (j = 0; j < count; j ++) {
+            if (systems[j] != elems[j].entity) {
+                return NULL;
+            }
+        }
+
+        return &phase[i];
+    }
+
+    return NULL;
+}
+
+/* Append the systems of a single phase to the schedule. Systems are grouped by
+ * staging mode, which changes require a merge. A system is never moved before
+ * a system that is declared earlier in the phase and that it conflicts with,
+ * so systems that depend on each other keep their order. Exclusive systems
+ * conflict with all systems, so systems are only moved between them. */
+static
+void order_phase(
+    schedule_elem_t *elems,
+    int32_t count,
+    const system_access_t *access,
+    bool *no_staging,
+    ecs_vector_t **schedule)
+{
+    int32_t i, j, remaining = 0;
+    bool mode = *no_staging;
+
+    for (i = 0; i < count; i ++) {
+        remaining += !elems[i].scheduled;
+    }
+
+    while (remaining) {
+        for (i = 0; i < count; i ++) {
+            schedule_elem_t *elem = &elems[i];
+            if (elem->scheduled || elem->sys->no_staging != mode) {
+                continue;
+            }
+
+            for (j = 0; j < i; j ++) {
+                if (!elems[j].scheduled &&
+                    elems_conflict(&elems[j], elem, access))
+                {
+                    break;
+                }
+            }
+
+            if (j != i) {
+                continue;
+            }
+
+            elem->scheduled = true;
+            *ecs_vector_add(schedule, schedule_elem_t) = *elem;
+            *no_staging = mode;
+            remaining --;
+        }
+
+        mode = !mode;
+    }
+}
+
 static
 bool build_pipeline(
     ecs_world_t *world,
     ecs_entity_t pipeline,
-    EcsPipelineQuery *pq)
+    EcsPipelineQuery *pq,
+    bool start_of_frame)
 {
     (void)pipeline;
 
     ecs_query_iter(world, pq->query);
 
-    if (pq->match_count == pq->query->match_count) {
-        /* No need to rebuild the pipeline */
-        return false;
+    int32_t stage_count = ecs_get_stage_count(world);
+
+    if (pq->match_count == pq->query->match_count &&
+        pq->stage_count == stage_count)
+    {
+        /* No need to rebuild the pipeline, unless the current schedule was
+         * built to resume a frame */
+        if (!start_of_frame || !pq->ran_count) {
+            return false;
+        }
+    }
+
+    ecs_time_t t_start;
+    bool measure_time = world->measure_frame_time;
+    if (measure_time) {
+        ecs_os_get_time(&t_start);
     }
 
     world->info.pipeline_build_count_total ++;
     pq->rebuild_count ++;
 
-    write_state_t ws = {
-        .components = ecs_map_new(int32_t, ECS_HI_COMPONENT_ID),
-        .wildcard = false
-    };
+    ecs_vector_t *elems = NULL, *access = NULL, *schedule = NULL;
+    ecs_vector_t *phases = NULL;
+    int32_t frame = world->info.frame_count_total + 1;
+    int32_t i, j, k, ran_count = 0;
 
-    ecs_pipeline_op_t *op = NULL;
-    ecs_vector_t *ops = NULL;
-    ecs_query_t *query = pq->build_query;
+    /* Collect active systems in pipeline order. When the pipeline is rebuilt
+     * after a merge, systems that already ran this frame go first so the
+     * pipeline can resume after them. */
+    ecs_iter_t it = ecs_query_iter(world, pq->query);
+    while (ecs_query_next(&it)) {
+        EcsSystem *sys = ecs_term(&it, EcsSystem, 1);
+        ecs_query_table_node_t *node = it.priv.iter.query.prev;
+        ecs_assert(node != NULL, ECS_INTERNAL_ERROR, NULL);
+        uint64_t phase = node->match->group_id;
+
+        for (i = 0; i < it.count; i ++) {
+            if (!sys[i].query) {
+                continue;
+            }
 
-    if (pq->ops) {
-        ecs_vector_free(pq->ops);
+            schedule_elem_t *elem = ecs_vector_add(&elems, schedule_elem_t);
+            elem->entity = it.entities[i];
+            elem->sys = &sys[i];
+            elem->phase = phase;
+            elem->index = ecs_vector_count(elems) - 1;
+            elem->access_first = -1;
+            elem->access_count = 0;
+            elem->exclusive = false;
+            elem->scheduled = !start_of_frame && sys[i].last_frame == frame;
+
+            if (elem->scheduled) {
+                *ecs_vector_add(&schedule, schedule_elem_t) = *elem;
+                ran_count ++;
+            }
+        }
     }
 
-    bool multi_threaded = false;
+    schedule_elem_t *elem_array = ecs_vector_first(elems, schedule_elem_t);
+    int32_t count = ecs_vector_count(elems);
     bool no_staging = false;
-    bool first = true;
 
-    /* Iterate systems in pipeline, add ops for running / merging */
-    ecs_iter_t it = ecs_query_iter(world, query);
-    while (ecs_query_next(&it)) {
-        EcsSystem *sys = ecs_term(&it, EcsSystem, 1);
+    for (i = 0; i < count; i ++) {
+        if (!elem_array[i].scheduled) {
+            no_staging = elem_array[i].sys->no_staging;
+            break;
+        }
+    }
 
-        int i;
-        for (i = 0; i < it.count; i ++) {      
-            ecs_query_t *q = sys[i].query;
-            if (!q) {
-                continue;
+    /* Reorder systems within each phase. Phases of which the active systems
+     * didn't change since the last build reuse their schedule. When resuming
+     * a frame, systems that already ran change the schedule, so phases are
+     * neither reused nor stored. */
+    for (i = 0; i < count; i += j) {
+        for (j = 1; (i + j) < count; j ++) {
+            if (elem_array[i + j].phase != elem_array[i].phase) {
+                break;
             }
+        }
 
-            bool needs_merge = false;
-            bool is_active = !ecs_has_id(
-                world, it.entities[i], EcsInactive);
-            needs_merge = check_terms(&q->filter, is_active, &ws);
-
-            if (is_active) {
-                if (first) {
-                    multi_threaded = sys[i].multi_threaded;
-                    no_staging = sys[i].no_staging;
-                    first = false;
-                }
+        schedule_elem_t *phase_elems = &elem_array[i];
+        ecs_pipeline_phase_t *phase = NULL;
+        if (!ran_count) {
+            phase = find_phase(pq->phases, phase_elems, j, no_staging);
+        }
 
-                if (sys[i].multi_threaded != multi_threaded) {
-                    needs_merge = true;
-                    multi_threaded = sys[i].multi_threaded;
-                }
-                if (sys[i].no_staging != no_staging) {
-                    needs_merge = true;
-                    no_staging = sys[i].no_staging;
-                }
+        if (phase) {
+            int32_t *order = ecs_vector_first(phase->order, int32_t);
+            for (k = 0; k < j; k ++) {
+                schedule_elem_t *elem = &phase_elems[order[k]];
+                elem->scheduled = true;
+                *ecs_vector_add(&schedule, schedule_elem_t) = *elem;
             }
 
-            if (needs_merge) {
-                /* After merge all components will be merged, so reset state */
-                reset_write_state(&ws);
-                op = NULL;
+            no_staging = phase_elems[order[j - 1]].sys->no_staging;
 
-                /* Re-evaluate columns to set write flags if system is active.
-                 * If system is inactive, it can't write anything and so it
-                 * should not insert unnecessary merges.  */
-                needs_merge = false;
-                if (is_active) {
-                    needs_merge = check_terms(&q->filter, true, &ws);
-                }
+            /* Move schedule to the new list of phases */
+            *ecs_vector_add(&phases, ecs_pipeline_phase_t) = *phase;
+            phase->systems = NULL;
+            phase->order = NULL;
+            continue;
+        }
 
-                /* The component states were just reset, so if we conclude that
-                 * another merge is needed something is wrong. */
-                ecs_assert(needs_merge == false, ECS_INTERNAL_ERROR, NULL);        
-            }
+        bool phase_no_staging = no_staging;
+        int32_t sched_first = ecs_vector_count(schedule);
+
+        for (k = 0; k < j; k ++) {
+            ensure_access(world, &phase_elems[k], &access);
+        }
+
+        order_phase(phase_elems, j, ecs_vector_first(access, system_access_t),
+            &no_staging, &schedule);
+
+        if (!ran_count) {
+            phase = ecs_vector_add(&phases, ecs_pipeline_phase_t);
+            phase->id = phase_elems[0].phase;
+            phase->systems = NULL;
+            phase->order = NULL;
+            phase->no_staging = phase_no_staging;
 
-            if (!op) {
-                op = ecs_vector_add(&ops, ecs_pipeline_op_t);
-                op->count = 0;
-                op->multi_threaded = false;
-                op->no_staging = false;
+            ecs_vector_set_count(&phase->systems, ecs_entity_t, j);
+            ecs_vector_set_count(&phase->order, int32_t, j);
+            ecs_entity_t *systems = ecs_vector_first(
+                phase->systems, ecs_entity_t);
+            int32_t *order = ecs_vector_first(phase->order, int32_t);
+            schedule_elem_t *sched = ecs_vector_get(
+                schedule, schedule_elem_t, sched_first);
+
+            for (k = 0; k < j; k ++) {
+                systems[k] = phase_elems[k].entity;
+                order[k] = sched[k].index - i;
             }
+        }
+    }
 
-            /* Don't increase count for inactive systems, as they are ignored by
-             * the query used to run the pipeline. */
-            if (is_active) {
-                if (!op->count) {
-                    op->multi_threaded = multi_threaded;
-                    op->no_staging = no_staging;
+    if (!ran_count) {
+        free_phases(pq->phases);
+        pq->phases = phases;
+    }
+
+    schedule_elem_t *sched = ecs_vector_first(schedule, schedule_elem_t);
+    ecs_assert(ecs_vector_count(schedule) == count, ECS_INTERNAL_ERROR, NULL);
+
+    /* Reuse the write state map across builds */
+    if (!pq->write_state) {
+        pq->write_state = ecs_map_new(int32_t, 0);
+    }
+
+    write_state_t ws = {
+        .components = pq->write_state,
+        .wildcard = false
+    };
+
+    reset_write_state(&ws);
+
+    ecs_vector_t *ops = NULL;
+    ecs_pipeline_op_t *op = NULL;
+    int32_t op_first = 0;
+
+    /* Systems that already ran are in their own op, and the pipeline always
+     * resumes at the next op, even if there are no systems left to run. */
+    if (ran_count) {
+        op = ecs_vector_add(&ops, ecs_pipeline_op_t);
+        op->count = ran_count;
+        op->multi_threaded = false;
+        op->no_staging = false;
+
+        op = ecs_vector_add(&ops, ecs_pipeline_op_t);
+        op->count = 0;
+        op->multi_threaded = false;
+        op->no_staging = false;
+        op_first = ran_count;
+    }
+
+    /* Add ops for running / merging. Merges are inserted when a system reads
+     * data written to the stage by an earlier system in the same op, when the
+     * staging mode changes, or when single and multi threaded systems in the
+     * same op access the same data. */
+    for (i = ran_count; i < count; i ++) {
+        schedule_elem_t *elem = &sched[i];
+        EcsSystem *sys = elem->sys;
+
+        bool needs_merge = check_terms(&sys->query->filter, true, &ws);
+
+        if (op && op->count) {
+            if (sys->no_staging != op->no_staging) {
+                needs_merge = true;
+            } else if (!needs_merge && !op->no_staging) {
+                for (j = op_first; j < i; j ++) {
+                    if (sched[j].sys->multi_threaded == sys->multi_threaded) {
+                        continue;
+                    }
+                    ensure_access(world, &sched[j], &access);
+                    ensure_access(world, elem, &access);
+                    if (elems_conflict(&sched[j], elem,
+                        ecs_vector_first(access, system_access_t)))
+                    {
+                        needs_merge = true;
+                        break;
+                    }
                 }
-                op->count ++;
             }
         }
+
+        if (needs_merge) {
+            /* After merge all components will be merged, so reset state */
+            reset_write_state(&ws);
+            op = NULL;
+
+            /* Re-evaluate columns to set write flags */
+            needs_merge = check_terms(&sys->query->filter, true, &ws);
+
+            /* The component states were just reset, so if we conclude that
+             * another merge is needed something is wrong. */
+            ecs_assert(needs_merge == false, ECS_INTERNAL_ERROR, NULL);
+        }
+
+        if (!op) {
+            op = ecs_vector_add(&ops, ecs_pipeline_op_t);
+            op->count = 0;
+            op_first = i;
+        }
+
+        if (!op->count) {
+            op->multi_threaded = false;
+            op->no_staging = sys->no_staging;
+        }
+
+        op->multi_threaded |= sys->multi_threaded;
+        op->count ++;
     }
 
-    ecs_map_free(ws.components);
+    /* A pipeline always has at least one op, so that workers and the main
+     * thread agree on the number of sync points. */
+    if (!ops) {
+        op = ecs_vector_add(&ops, ecs_pipeline_op_t);
+        op->count = 0;
+        op->multi_threaded = false;
+        op->no_staging = false;
+    }
 
-    /* Find the system ran last this frame (helps workers reset iter) */
-    ecs_entity_t last_system = 0;
-    op = ecs_vector_first(ops, ecs_pipeline_op_t);
-    int32_t i, ran_since_merge = 0, op_index = 0;
+    /* Lanes only matter when systems are distributed across workers */
+    if (stage_count > 1) {
+        build_lanes(world, sched, ops);
+    }
 
-    if (!op) {
+    /* Add schedule to debug tracing */
+    if (!count) {
         ecs_dbg("#[green]pipeline#[reset] is empty");
-        return true;
     } else {
+        ecs_pipeline_op_t *op_array = ecs_vector_first(ops, ecs_pipeline_op_t);
+        int32_t o, op_count = ecs_vector_count(ops);
 
-        ecs_assert(op != NULL, ECS_INTERNAL_ERROR, NULL);
-
-        /* Add schedule to debug tracing */
         ecs_dbg("#[green]pipeline#[reset] rebuild:");
         ecs_log_push_1();
 
-        ecs_dbg("#[green]schedule#[reset]: threading: %d, staging: %d:", 
-            op->multi_threaded, !op->no_staging);
-        ecs_log_push_1();
-        
-        it = ecs_query_iter(world, pq->query);
-        while (ecs_query_next(&it)) {
-            EcsSystem *sys = ecs_term(&it, EcsSystem, 1);
-            for (i = 0; i < it.count; i ++) {
+        for (o = 0, i = 0; o < op_count; o ++) {
+            op = &op_array[o];
+            ecs_dbg("#[green]schedule#[reset]: threading: %d, staging: %d:",
+                op->multi_threaded, !op->no_staging);
+            ecs_log_push_1();
+
+            for (j = 0; j < op->count; j ++, i ++) {
                 if (ecs_should_log_1()) {
-                    char *path = ecs_get_fullpath(world, it.entities[i]);
-                    ecs_dbg("#[green]system#[reset] %s", path);
+                    EcsSystem *sys = sched[i].sys;
+                    char *path = ecs_get_fullpath(world, sched[i].entity);
+                    if (sys->multi_threaded || op->no_staging ||
+                        stage_count <= 1)
+                    {
+                        ecs_dbg("#[green]system#[reset] %s", path);
+                    } else {
+                        ecs_dbg("#[green]system#[reset] %s (lane %d)",
+                            path, sys->lane);
+                    }
                     ecs_os_free(path);
                 }
+            }
 
-                ran_since_merge ++;
-                if (ran_since_merge == op[op_index].count) {
-                    ecs_dbg("#[magenta]merge#[reset]");
-                    ecs_log_pop_1();
-                    ran_since_merge = 0;
-                    op_index ++;
-                    if (op_index < ecs_vector_count(ops)) {
-                        ecs_dbg(
-                            "#[green]schedule#[reset]: "
-                            "threading: %d, staging: %d:",
-                            op[op_index].multi_threaded, 
-                            !op[op_index].no_staging);
-                    }
-                    ecs_log_push_1();
-                }
+            ecs_dbg("#[magenta]merge#[reset]");
+            ecs_log_pop_1();
+        }
 
-                if (sys[i].last_frame == (world->info.frame_count_total + 1)) {
-                    last_system = it.entities[i];
+        ecs_log_pop_1();
+    }
 
-                    /* Can't break from loop yet. It's possible that previously
-                    * inactive systems that ran before the last ran system are 
-                    * now active. */
-                }
-            }
+    /* Store system ids in the order they are ran */
+    ecs_vector_free(pq->systems);
+    pq->systems = NULL;
+    if (count) {
+        ecs_vector_set_count(&pq->systems, ecs_entity_t, count);
+        ecs_entity_t *systems = ecs_vector_first(pq->systems, ecs_entity_t);
+        for (i = 0; i < count; i ++) {
+            systems[i] = sched[i].entity;
         }
     }
 
-    ecs_log_pop_1();
-    ecs_log_pop_1();
+    ecs_vector_free(elems);
+    ecs_vector_free(access);
+    ecs_vector_free(schedule);
+    ecs_vector_free(pq->ops);
 
-    /* Force sort of query as this could increase the match_count */
     pq->match_count = pq->query->match_count;
+    pq->stage_count = stage_count;
     pq->ops = ops;
-    pq->last_system = last_system;
+    pq->ran_count = ran_count;
+
+    if (measure_time) {
+        world->info.pipeline_build_time_total +=
+            (float)ecs_time_measure(&t_start);
+    }
 
     return true;
 }
@@ -15149,42 +16875,31 @@ bool build_pipeline(
 int32_t ecs_pipeline_reset_iter(
     ecs_world_t *world,
     const EcsPipelineQuery *pq,
-    ecs_iter_t *iter_out,
     ecs_pipeline_op_t **op_out,
     ecs_pipeline_op_t **last_op_out)
 {
+    (void)world;
+
     ecs_pipeline_op_t *op = ecs_vector_first(pq->ops, ecs_pipeline_op_t);
-    int32_t i, ran_since_merge = 0, op_index = 0;
+    ecs_assert(op != NULL, ECS_INTERNAL_ERROR, NULL);
 
-    if (!pq->last_system) {
+    *last_op_out = ecs_vector_last(pq->ops, ecs_pipeline_op_t);
+
+    if (!pq->ran_count) {
         /* It's possible that all systems that were ran were removed entirely
          * from the pipeline (they could have been deleted or disabled). In that
-         * case (which should be very rare) the pipeline can't make assumptions
-         * about where to continue, so end frame. */
+         * case start from the first op, which only has systems that haven't
+         * been ran yet. */
+        *op_out = op;
         return -1;
     }
 
-    /* Move iterator to last ran system */
-    *iter_out = ecs_query_iter(world, pq->query);
-    while (ecs_query_next(iter_out)) {
-        for (i = 0; i < iter_out->count; i ++) {
-            ran_since_merge ++;
-            if (ran_since_merge == op[op_index].count) {
-                ran_since_merge = 0;
-                op_index ++;
-            }
-
-            if (iter_out->entities[i] == pq->last_system) {
-                *op_out = &op[op_index];
-                *last_op_out = ecs_vector_last(pq->ops, ecs_pipeline_op_t);
-                return i;
-            }
-        }
-    }
-
-    ecs_abort(ECS_INTERNAL_ERROR, NULL);
+    /* Systems that were ran are stored in the first op, resume at the next */
+    ecs_assert(op[0].count == pq->ran_count, ECS_INTERNAL_ERROR, NULL);
+    ecs_assert(ecs_vector_count(pq->ops) > 1, ECS_INTERNAL_ERROR, NULL);
+    *op_out = &op[1];
 
-    return -1;
+    return pq->ran_count - 1;
 }
 
 bool ecs_pipeline_update(
@@ -15209,7 +16924,7 @@ bool ecs_pipeline_update(
     ecs_assert(pq != NULL, ECS_INTERNAL_ERROR, NULL);
     ecs_assert(pq->query != NULL, ECS_INTERNAL_ERROR, NULL);
 
-    return build_pipeline(world, pipeline, pq);
+    return build_pipeline(world, pipeline, pq, start_of_frame);
 }
 
 void ecs_run_pipeline(
@@ -15251,6 +16966,8 @@ void ecs_run_pipeline(
     ecs_vector_t *ops = pq->ops;
     ecs_pipeline_op_t *op = ecs_vector_first(ops, ecs_pipeline_op_t);
     ecs_pipeline_op_t *op_last = ecs_vector_last(ops, ecs_pipeline_op_t);
+    ecs_entity_t *systems = ecs_vector_first(pq->systems, ecs_entity_t);
+    int32_t i, count = ecs_vector_count(pq->systems);
     int32_t ran_since_merge = 0;
 
     int32_t stage_index = ecs_get_stage_id(stage->thread_ctx);
@@ -15258,48 +16975,55 @@ void ecs_run_pipeline(
 
     ecs_worker_begin(stage->thread_ctx);
 
-    ecs_iter_t it = ecs_query_iter(world, pq->query);
-    while (ecs_query_next(&it)) {
-        EcsSystem *sys = ecs_term(&it, EcsSystem, 1);
-
-        int32_t i;
-        for(i = 0; i < it.count; i ++) {
-            ecs_entity_t e = it.entities[i];
-
-            if (!stage_index) {
-                ecs_dbg_3("pipeline: run system %s", ecs_get_name(world, e));
-            }
-
-            if (!stage_index || op->multi_threaded) {
-                ecs_stage_t *s = NULL;
-                if (!op->no_staging) {
-                    s = stage;
-                }
+    for (i = 0; i < count; i ++) {
+        ecs_entity_t e = systems[i];
+        EcsSystem *sys = (EcsSystem*)ecs_get(world, e, EcsSystem);
+        ecs_assert(sys != NULL, ECS_INTERNAL_ERROR, NULL);
+
+        if (!stage_index) {
+            ecs_dbg_3("pipeline: run system %s", ecs_get_name(world, e));
+        }
+
+        /* Multi threaded systems run on all workers. Single threaded,
+         * staged systems run on the worker that owns their lane, so
+         * systems that don't share data can run at the same time. */
+        bool run;
+        if (op->no_staging) {
+            run = !stage_index;
+        } else if (sys->multi_threaded) {
+            run = true;
+        } else {
+            run = (sys->lane % stage_count) == stage_index;
+        }
 
-                ecs_run_intern(world, s, e, &sys[i], stage_index, 
-                    stage_count, delta_time, 0, 0, NULL);
+        if (run) {
+            ecs_stage_t *s = NULL;
+            if (!op->no_staging) {
+                s = stage;
             }
 
-            sys[i].last_frame = world->info.frame_count_total + 1;
+            ecs_run_intern(world, s, e, sys, stage_index, 
+                stage_count, delta_time, 0, 0, NULL);
+        }
 
-            ran_since_merge ++;
-            world->info.systems_ran_frame ++;
+        sys->last_frame = world->info.frame_count_total + 1;
 
-            if (op != op_last && ran_since_merge == op->count) {
-                ran_since_merge = 0;
+        ran_since_merge ++;
+        world->info.systems_ran_frame ++;
 
-                if (!stage_index) {
-                    ecs_dbg_3("merge");
-                }
+        if (op != op_last && ran_since_merge == op->count) {
+            ran_since_merge = 0;
 
-                /* If the set of matched systems changed as a result of the
-                 * merge, we have to reset the iterator and move it to our
-                 * current position (system). If there are a lot of systems
-                 * in the pipeline this can be an expensive operation, but
-                 * should happen infrequently. */
-                i = ecs_worker_sync(world, pq, &it, i, &op, &op_last);
-                sys = ecs_term(&it, EcsSystem, 1);
+            if (!stage_index) {
+                ecs_dbg_3("merge");
             }
+
+            /* If the set of matched systems changed as a result of the
+             * merge, the pipeline is rebuilt and we have to move to our
+             * current position in the new schedule. */
+            i = ecs_worker_sync(world, &pq, i, &op, &op_last);
+            systems = ecs_vector_first(pq->systems, ecs_entity_t);
+            count = ecs_vector_count(pq->systems);
         }
     }
 
@@ -15451,7 +17175,10 @@ void OnUpdatePipeline(
         pq->build_query = build_query;
         pq->match_count = -1;
         pq->ops = NULL;
-        pq->last_system = 0;
+        pq->systems = NULL;
+        pq->phases = NULL;
+        pq->write_state = NULL;
+        pq->ran_count = 0;
 
         ecs_log_pop();
     }
@@ -18949,6 +20676,22 @@ ecs_rule_filter_t pair_to_filter(
         result.mask = pred;
     } else {
         result.mask = ecs_pair(pred, obj);
+
+        /* Union cases aren't stored in the table type. Match tables on the
+         * union column, rows are filtered on case when the result is yielded */
+        const ecs_term_t *terms = it->rule->filter.terms;
+        if (!result.pred_wildcard && 
+            (op->term == -1 || terms[op->term].oper != EcsNot)) 
+        {
+            ecs_id_record_t *idr = flecs_get_id_record(it->rule->world, 
+                ecs_pair(pred, EcsWildcard));
+            if (idr && idr->flags & EcsIdUnion) {
+                result.mask = ecs_pair(EcsUnion, pred);
+                result.wildcard = false;
+                result.obj_wildcard = false;
+                result.lo_var = -1;
+            }
+        }
     }
 
     return result;
@@ -22262,6 +24005,147 @@ void populate_iterator(
         iter->ptrs, iter->sizes);
 }
 
+typedef struct rule_union_term_t {
+    ecs_switch_t *sw;
+    ecs_entity_t value;     /* Case to match, 0 if term has wildcard/variable */
+    int32_t term;
+    bool is_not;
+} rule_union_term_t;
+
+static
+bool rule_union_match_row(
+    rule_union_term_t *terms,
+    int32_t count,
+    int32_t row,
+    int32_t first)
+{
+    int32_t i;
+    for (i = 0; i < count; i ++) {
+        rule_union_term_t *ut = &terms[i];
+        ecs_entity_t value = flecs_switch_get(ut->sw, row);
+        if (ut->is_not) {
+            if (value == ut->value) {
+                return false;
+            }
+        } else if (!value) {
+            return false;
+        } else if (ut->value) {
+            if (value != ut->value) {
+                return false;
+            }
+        } else if (first != -1 && value != flecs_switch_get(ut->sw, first)) {
+            /* Don't mix cases in a single result for wildcards/variables, so
+             * that the id of the term is the same for all returned rows */
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/* Union relationships are matched on table level by the rule program. Narrow
+ * the yielded result down to the next range of rows that match the requested
+ * union cases. Returns false if no remaining rows in the table match. */
+static
+bool rule_union_next(
+    ecs_iter_t *it,
+    ecs_rule_iter_t *iter)
+{
+    const ecs_rule_t *rule = iter->rule;
+    ecs_world_t *world = rule->world;
+    ecs_table_t *table = it->table;
+    int32_t row = iter->union_row, end = iter->union_end;
+
+    iter->union_row = end;
+
+    if (!table || !(table->flags & EcsTableHasUnion)) {
+        return true;
+    }
+
+    int32_t i, term_count = rule->filter.term_count, union_count = 0;
+    rule_union_term_t *terms = ecs_os_alloca_n(rule_union_term_t, term_count);
+    for (i = 0; i < term_count; i ++) {
+        ecs_term_t *term = &rule->filter.terms[i];
+        int32_t column = it->columns[i];
+        if (term->oper == EcsNot) {
+            /* Not terms for a union case pass on table level */
+            if (!ECS_HAS_ROLE(term->id, PAIR) || ecs_id_is_wildcard(term->id)){
+                continue;
+            }
+            column = ecs_search(world, table, 
+                ecs_pair(EcsUnion, ECS_PAIR_FIRST(term->id)), 0) + 1;
+        } else if (term->oper != EcsAnd) {
+            continue;
+        }
+
+        if (column <= 0 || 
+            ECS_PAIR_FIRST(table->type.array[column - 1]) != EcsUnion) 
+        {
+            continue;
+        }
+
+        rule_union_term_t *ut = &terms[union_count ++];
+        ut->sw = &table->data.sw_columns[column - 1 - table->sw_offset];
+        ut->term = i;
+        ut->is_not = term->oper == EcsNot;
+        ut->value = 0;
+        if (ut->is_not || rule->term_vars[i].obj == -1) {
+            ut->value = ECS_PAIR_SECOND(term->id);
+        } else if (ecs_iter_var_is_constrained(it, rule->term_vars[i].obj)) {
+            /* Variable was set by the application before iterating */
+            ut->value = it->variables[rule->term_vars[i].obj].entity;
+        }
+    }
+
+    if (!union_count) {
+        return true;
+    }
+
+    for (; row < end; row ++) {
+        if (rule_union_match_row(terms, union_count, row, -1)) {
+            break;
+        }
+    }
+
+    if (row == end) {
+        return false;
+    }
+
+    int32_t first = row;
+    for (row ++; row < end; row ++) {
+        if (!rule_union_match_row(terms, union_count, row, first)) {
+            break;
+        }
+    }
+
+    iter->union_row = row;
+
+    /* Replace (Union, Relation) with the actual case for wildcard terms */
+    for (i = 0; i < union_count; i ++) {
+        rule_union_term_t *ut = &terms[i];
+        if (ut->value || ut->is_not) {
+            continue;
+        }
+
+        ecs_id_t id = table->type.array[it->columns[ut->term] - 1];
+        ecs_entity_t value = flecs_switch_get(ut->sw, first);
+        it->ids[ut->term] = ecs_pair(ECS_PAIR_SECOND(id), value);
+        if (it->variables) {
+            it->variables[rule->term_vars[ut->term].obj].entity = 
+                ecs_get_alive(world, value);
+        }
+    }
+
+    if (first != it->offset || row != (it->offset + it->count)) {
+        int32_t frame_offset = it->frame_offset;
+        flecs_iter_populate_data(world, it, table, first, row - first,
+            it->ptrs, it->sizes);
+        it->frame_offset = frame_offset;
+    }
+
+    return true;
+}
+
 static
 bool is_control_flow(
     ecs_rule_op_t *op)
@@ -22374,6 +24258,11 @@ bool ecs_rule_next_instanced(
     if (first_time) {
         ecs_assert(redo == false, ECS_INTERNAL_ERROR, NULL);
         rule_iter_set_initial_state(it, iter, rule);
+    } else if (iter->union_row < iter->union_end) {
+        /* Yield remaining rows of the last table that match union cases */
+        if (rule_union_next(it, iter)) {
+            return true;
+        }
     }
 
     do {
@@ -22412,7 +24301,12 @@ bool ecs_rule_next_instanced(
         if (op->kind == EcsRuleYield) {
             populate_iterator(rule, it, iter, op);
             iter->redo = true;
-            return true;
+
+            iter->union_row = it->offset;
+            iter->union_end = it->offset + it->count;
+            if (rule_union_next(it, iter)) {
+                return true;
+            }
         }
 
         /* If the current operation is a jump, goto stored label */
@@ -25592,43 +27486,43 @@ int expr_ser_primitive(
         break;
     }
     case EcsByte:
-        ecs_strbuf_append(str, "%u", *(uint8_t*)base);
+        ecs_strbuf_appenduint(str, *(uint8_t*)base);
         break;
     case EcsU8:
-        ecs_strbuf_append(str, "%u", *(uint8_t*)base);
+        ecs_strbuf_appenduint(str, *(uint8_t*)base);
         break;
     case EcsU16:
-        ecs_strbuf_append(str, "%u", *(uint16_t*)base);
+        ecs_strbuf_appenduint(str, *(uint16_t*)base);
         break;
     case EcsU32:
-        ecs_strbuf_append(str, "%u", *(uint32_t*)base);
+        ecs_strbuf_appenduint(str, *(uint32_t*)base);
         break;
     case EcsU64:
-        ecs_strbuf_append(str, "%llu", *(uint64_t*)base);
+        ecs_strbuf_appenduint(str, *(uint64_t*)base);
         break;
     case EcsI8:
-        ecs_strbuf_append(str, "%d", *(int8_t*)base);
+        ecs_strbuf_appendint(str, *(int8_t*)base);
         break;
     case EcsI16:
-        ecs_strbuf_append(str, "%d", *(int16_t*)base);
+        ecs_strbuf_appendint(str, *(int16_t*)base);
         break;
     case EcsI32:
-        ecs_strbuf_append(str, "%d", *(int32_t*)base);
+        ecs_strbuf_appendint(str, *(int32_t*)base);
         break;
     case EcsI64:
-        ecs_strbuf_append(str, "%lld", *(int64_t*)base);
+        ecs_strbuf_appendint(str, *(int64_t*)base);
         break;
     case EcsF32:
-        ecs_strbuf_appendflt(str, (double)*(float*)base, 0);
+        ecs_strbuf_appendflt32(str, *(float*)base, 0);
         break;
     case EcsF64:
         ecs_strbuf_appendflt(str, *(double*)base, 0);
         break;
     case EcsIPtr:
-        ecs_strbuf_append(str, "%i", *(intptr_t*)base);
+        ecs_strbuf_appendint(str, *(intptr_t*)base);
         break;
     case EcsUPtr:
-        ecs_strbuf_append(str, "%u", *(uintptr_t*)base);
+        ecs_strbuf_appenduint(str, *(uintptr_t*)base);
         break;
     case EcsString: {
         char *value = *(char**)base;
@@ -26475,6 +28369,7 @@ void ecs_get_world_stats(
     record_counter(&s->frame_time_total, t, world->info.frame_time_total);
     record_counter(&s->system_time_total, t, world->info.system_time_total);
     record_counter(&s->merge_time_total, t, world->info.merge_time_total);
+    record_counter(&s->pipeline_build_time_total, t, world->info.pipeline_build_time_total);
 
     float delta_frame_count = record_counter(&s->frame_count_total, t, world->info.frame_count_total);
     record_counter(&s->merge_count_total, t, world->info.merge_count_total);
@@ -26508,6 +28403,9 @@ void ecs_get_world_stats(
     record_counter(&s->id_delete_count, t, world->info.id_delete_total);
     record_counter(&s->table_create_count, t, world->info.table_create_total);
     record_counter(&s->table_delete_count, t, world->info.table_delete_total);
+    record_counter(&s->table_realloc_count, t, world->info.table_realloc_total);
+    record_counter(&s->event_emit_count, t, world->info.event_emit_total);
+    record_counter(&s->event_skip_count, t, world->info.event_skip_total);
 
     record_counter(&s->new_count, t, world->new_count);
     record_counter(&s->bulk_new_count, t, world->bulk_new_count);
@@ -26658,16 +28556,11 @@ bool ecs_get_pipeline_stats(
         return false;
     }
 
-    int32_t sys_count = 0, active_sys_count = 0;
-
-    /* Count number of active systems */
-    ecs_iter_t it = ecs_query_iter(stage, pq->query);
-    while (ecs_query_next(&it)) {
-        active_sys_count += it.count;
-    }
+    int32_t sys_count = 0;
+    int32_t active_sys_count = ecs_vector_count(pq->systems);
 
     /* Count total number of systems in pipeline */
-    it = ecs_query_iter(stage, pq->build_query);
+    ecs_iter_t it = ecs_query_iter(stage, pq->build_query);
     while (ecs_query_next(&it)) {
         sys_count += it.count;
     }   
@@ -26699,18 +28592,15 @@ bool ecs_get_pipeline_stats(
         systems = ecs_vector_first(s->systems, ecs_entity_t);
 
         /* Populate systems vector, keep track of sync points */
-        it = ecs_query_iter(stage, pq->query);
-        
+        ecs_entity_t *pq_systems = ecs_vector_first(pq->systems, ecs_entity_t);
         int32_t i, i_system = 0, ran_since_merge = 0;
-        while (ecs_query_next(&it)) {
-            for (i = 0; i < it.count; i ++) {
-                systems[i_system ++] = it.entities[i];
-                ran_since_merge ++;
-                if (op != op_last && ran_since_merge == op->count) {
-                    ran_since_merge = 0;
-                    op++;
-                    systems[i_system ++] = 0; /* 0 indicates a merge point */
-                }
+        for (i = 0; i < active_sys_count; i ++) {
+            systems[i_system ++] = pq_systems[i];
+            ran_since_merge ++;
+            if (op != op_last && ran_since_merge == op->count) {
+                ran_since_merge = 0;
+                op++;
+                systems[i_system ++] = 0; /* 0 indicates a merge point */
             }
         }
 
@@ -26721,6 +28611,11 @@ bool ecs_get_pipeline_stats(
         s->systems = NULL;
     }
 
+    s->system_count = sys_count;
+    s->active_system_count = active_sys_count;
+    s->merge_count = ecs_vector_count(ops);
+    s->rebuild_count = pq->rebuild_count;
+
     /* Separately populate system stats map from build query, which includes
      * systems that aren't currently active */
     it = ecs_query_iter(stage, pq->build_query);
@@ -26770,6 +28665,7 @@ void ecs_dump_world_stats(
     print_counter("frame time", t, &s->frame_time_total);
     print_counter("system time", t, &s->system_time_total);
     print_counter("merge time", t, &s->merge_time_total);
+    print_counter("pipeline build time", t, &s->pipeline_build_time_total);
     print_counter("simulation time elapsed", t, &s->world_time_total);
     ecs_trace("");
     print_gauge("id count", t, &s->id_count);
@@ -26786,6 +28682,8 @@ void ecs_dump_world_stats(
     print_gauge("trigger count", t, &s->trigger_count);
     print_gauge("observer count", t, &s->observer_count);
     print_gauge("system count", t, &s->system_count);
+    print_counter("event emit count", t, &s->event_emit_count);
+    print_counter("event skip count", t, &s->event_skip_count);
     ecs_trace("");
     print_gauge("table count", t, &s->table_count);
     print_gauge("empty table count", t, &s->empty_table_count);
@@ -26797,6 +28695,7 @@ void ecs_dump_world_stats(
     ecs_trace("");
     print_counter("table create count", t, &s->table_create_count);
     print_counter("table delete count", t, &s->table_delete_count);
+    print_counter("table realloc count", t, &s->table_realloc_count);
     print_counter("id create count", t, &s->id_create_count);
     print_counter("id delete count", t, &s->id_delete_count);
     ecs_trace("");
@@ -28585,6 +30484,25 @@ void EnableMonitor(
     }
 }
 
+/* Make the system query skip tables of which the inputs didn't change since
+ * the last time they were iterated. Workers of a multi threaded system iterate
+ * the same tables, and a sorted query can return the same table more than
+ * once, which would cause tables to be skipped after the first iteration. */
+static
+void skip_unchanged_tables(
+    EcsSystem *system)
+{
+    ecs_query_t *query = system->query;
+    ecs_check(!system->multi_threaded, ECS_INVALID_PARAMETER, 
+        "skip_unchanged cannot be combined with multi_threaded");
+    ecs_check(!query->order_by, ECS_INVALID_PARAMETER, 
+        "skip_unchanged cannot be combined with order_by");
+
+    query->flags |= EcsQuerySkipUnchanged | EcsQueryHasMonitor;
+error:
+    return;
+}
+
 ecs_entity_t ecs_system_init(
     ecs_world_t *world,
     const ecs_system_desc_t *desc)
@@ -28643,6 +30561,11 @@ ecs_entity_t ecs_system_init(
 
         system->multi_threaded = desc->multi_threaded;
         system->no_staging = desc->no_staging;
+        system->concurrent = desc->concurrent;
+
+        if (desc->skip_unchanged) {
+            skip_unchanged_tables(system);
+        }
 
         /* If tables have been matched with this system it is active, and we
          * should activate the in terms, if any. This will ensure that any
@@ -28715,6 +30638,12 @@ ecs_entity_t ecs_system_init(
         if (desc->no_staging) {
             system->no_staging = desc->no_staging;
         }
+        if (desc->concurrent) {
+            system->concurrent = desc->concurrent;
+        }
+        if (desc->skip_unchanged) {
+            skip_unchanged_tables(system);
+        }
     }
 
     return result;
@@ -29170,8 +31099,8 @@ int json_ser_type_op(
         ecs_throw(ECS_INVALID_PARAMETER, NULL);
         break;
     case EcsOpF32:
-        ecs_strbuf_appendflt(str, 
-            (ecs_f64_t)*(ecs_f32_t*)ECS_OFFSET(ptr, op->offset), '"');
+        ecs_strbuf_appendflt32(str, 
+            *(ecs_f32_t*)ECS_OFFSET(ptr, op->offset), '"');
         break;
     case EcsOpF64:
         ecs_strbuf_appendflt(str, 
@@ -30787,13 +32716,41 @@ error:
 
 #ifdef FLECS_REST
 
+/* Max number of bytes queued for an event stream client that doesn't keep up */
+#define ECS_REST_STREAM_QUEUE_SIZE (64 * 1024)
+
+/* Max number of ids that can be observed by a single event stream */
+#define ECS_REST_STREAM_ID_MAX (8)
+
+/* Interval (s) after which an idle event stream is sent a comment, which is
+ * used to detect clients that disconnected */
+#define ECS_REST_STREAM_KEEPALIVE_INTERVAL (5.0)
+
+/* Client subscribed to an event stream */
+typedef struct {
+    ecs_world_t *world;
+    ecs_http_stream_t *stream;
+    ecs_entity_t observers[ECS_REST_STREAM_ID_MAX];
+    int32_t observer_count;
+    ecs_strbuf_t events;        /* Events collected in the current frame */
+    int32_t event_count;
+    ecs_id_t last_id;           /* Id of last event */
+    char *last_id_json;         /* Serialized id members of last event */
+    FLECS_FLOAT idle_time;
+} ecs_rest_subscriber_t;
+
 typedef struct {
     ecs_world_t *world;
     ecs_entity_t entity;
     ecs_http_server_t *srv;
+    ecs_vector_t *subscribers;  /* vector<ecs_rest_subscriber_t*> */
     int32_t rc;
 } ecs_rest_ctx_t;
 
+static
+void rest_subscriber_free(
+    ecs_rest_subscriber_t *sub);
+
 static ECS_COPY(EcsRest, dst, src, {
     ecs_rest_ctx_t *impl = src->impl;
     if (impl) {
@@ -30816,6 +32773,10 @@ static ECS_DTOR(EcsRest, ptr, {
     if (impl) {
         impl->rc --;
         if (!impl->rc) {
+            ecs_vector_each(impl->subscribers, ecs_rest_subscriber_t*, sub, {
+                rest_subscriber_free(*sub);
+            });
+            ecs_vector_free(impl->subscribers);
             ecs_http_server_fini(impl->srv);
             ecs_os_free(impl);
         }
@@ -30931,6 +32892,340 @@ void rest_parse_json_ser_iter_params(
     rest_bool_param(req, "type_info", &desc->serialize_type_info);
 }
 
+/* Binary columnar format. Component data is written as raw column buffers,
+ * which avoids the cost of formatting each value as text. All integers are 
+ * written in host byte order, which clients can detect from the byte order 
+ * mark in the header. Sections are padded to 8 bytes so that clients can 
+ * directly map columns to arrays.
+ *
+ * header:  "FLCB", u32 byte_order_mark (0x01020304), u32 schema_length
+ * schema:  JSON object with for each term its id, size and type info
+ * results: u32 count, u32 term_count, u32 owned_mask, u32 shared_mask,
+ *          u64 entities[count], for each term in owned_mask a column with
+ *          count elements, for each term in shared_mask a single element
+ * end:     result header with all fields set to 0
+ */
+#define ECS_REST_BINARY_MAGIC "FLCB"
+#define ECS_REST_BINARY_BOM (0x01020304)
+#define ECS_REST_BINARY_TERM_MAX (32)
+
+static
+void rest_binary_pad(
+    ecs_strbuf_t *buf)
+{
+    static const char zeros[8] = {0};
+    int32_t written = ecs_strbuf_written(buf);
+    int32_t padding = ECS_ALIGN(written, 8) - written;
+    if (padding) {
+        ecs_strbuf_appendbin(buf, zeros, padding);
+    }
+}
+
+static
+void rest_binary_u32(
+    ecs_strbuf_t *buf,
+    uint32_t value)
+{
+    ecs_strbuf_appendbin(buf, &value, ECS_SIZEOF(uint32_t));
+}
+
+static
+void rest_binary_schema(
+    const ecs_world_t *world,
+    const ecs_iter_t *it,
+    ecs_strbuf_t *buf)
+{
+    flecs_json_object_push(buf);
+    flecs_json_member(buf, "terms");
+    flecs_json_array_push(buf);
+
+    int32_t i, term_count = it->term_count;
+    for (i = 0; i < term_count; i ++) {
+        ecs_id_t id = it->terms[i].id;
+        ecs_entity_t type = ecs_get_typeid(world, id);
+        const EcsComponent *comp = NULL;
+        if (type) {
+            comp = ecs_get(world, type, EcsComponent);
+        }
+
+        flecs_json_next(buf);
+        flecs_json_object_push(buf);
+        flecs_json_member(buf, "id");
+        flecs_json_id(buf, world, id);
+        flecs_json_member(buf, "size");
+        ecs_strbuf_appendint(buf, comp ? comp->size : 0);
+        flecs_json_member(buf, "type");
+        if (comp) {
+            ecs_type_info_to_json_buf(world, type, buf);
+        } else {
+            flecs_json_literal(buf, "0");
+        }
+        flecs_json_object_pop(buf);
+    }
+
+    flecs_json_array_pop(buf);
+    flecs_json_object_pop(buf);
+}
+
+static
+int rest_iter_to_binary_buf(
+    const ecs_world_t *world,
+    ecs_iter_t *it,
+    ecs_strbuf_t *buf)
+{
+    int32_t i, term_count = it->term_count;
+    if (term_count > ECS_REST_BINARY_TERM_MAX) {
+        return -1;
+    }
+
+    ecs_strbuf_t schema = ECS_STRBUF_INIT;
+    rest_binary_schema(world, it, &schema);
+    char *schema_str = ecs_strbuf_get(&schema);
+    int32_t schema_len = schema.length - 1;
+
+    ecs_strbuf_appendbin(buf, ECS_REST_BINARY_MAGIC, 4);
+    rest_binary_u32(buf, ECS_REST_BINARY_BOM);
+    rest_binary_u32(buf, flecs_ito(uint32_t, schema_len));
+    ecs_strbuf_appendbin(buf, schema_str, schema_len);
+    rest_binary_pad(buf);
+    ecs_os_free(schema_str);
+
+    /* Use instancing so each result is a full table range */
+    ECS_BIT_SET(it->flags, EcsIterIsInstanced);
+
+    ecs_iter_next_action_t next = it->next;
+    while (next(it)) {
+        int32_t count = it->count;
+        uint32_t owned_mask = 0, shared_mask = 0;
+
+        for (i = 0; i < term_count; i ++) {
+            if (!it->ptrs[i] || !it->sizes[i]) {
+                continue;
+            }
+            if (ecs_term_is_writeonly(it, i + 1)) {
+                continue;
+            }
+            if (ecs_term_is_owned(it, i + 1)) {
+                owned_mask |= 1u << i;
+            } else {
+                shared_mask |= 1u << i;
+            }
+        }
+
+        rest_binary_u32(buf, flecs_ito(uint32_t, count));
+        rest_binary_u32(buf, flecs_ito(uint32_t, term_count));
+        rest_binary_u32(buf, owned_mask);
+        rest_binary_u32(buf, shared_mask);
+
+        if (count) {
+            ecs_strbuf_appendbin(buf, it->entities, 
+                count * ECS_SIZEOF(ecs_entity_t));
+        }
+
+        for (i = 0; i < term_count; i ++) {
+            if (owned_mask & (1u << i)) {
+                ecs_strbuf_appendbin(buf, it->ptrs[i], count * it->sizes[i]);
+                rest_binary_pad(buf);
+            } else if (shared_mask & (1u << i)) {
+                ecs_strbuf_appendbin(buf, it->ptrs[i], it->sizes[i]);
+                rest_binary_pad(buf);
+            }
+        }
+    }
+
+    for (i = 0; i < 4; i ++) {
+        rest_binary_u32(buf, 0);
+    }
+
+    return 0;
+}
+
+static
+void rest_stream_observer(
+    ecs_iter_t *it)
+{
+    if (ecs_is_fini(it->world)) {
+        return;
+    }
+
+    ecs_rest_subscriber_t *sub = it->ctx;
+    ecs_world_t *world = sub->world;
+    ecs_strbuf_t *buf = &sub->events;
+    ecs_id_t id = ecs_term_id(it, 1);
+
+    /* Consecutive events often have the same id, so only serialize it once */
+    if (!sub->last_id_json || (sub->last_id != id)) {
+        ecs_strbuf_t id_buf = ECS_STRBUF_INIT;
+        ecs_strbuf_appendstr(&id_buf, ", \"id\":");
+        flecs_json_id(&id_buf, world, id);
+        if (ECS_HAS_ROLE(id, PAIR)) {
+            ecs_strbuf_appendstr(&id_buf, ", \"object\":");
+            flecs_json_label(&id_buf, world, ecs_pair_object(world, id));
+        }
+        ecs_os_free(sub->last_id_json);
+        sub->last_id_json = ecs_strbuf_get(&id_buf);
+        sub->last_id = id;
+    }
+
+    int32_t i;
+    for (i = 0; i < it->count; i ++) {
+        if (!sub->event_count) {
+            ecs_strbuf_append(buf, 
+                "data: {\"frame\":%d, \"dropped\":%d, \"events\":",
+                    ecs_get_world_info(world)->frame_count_total, 
+                    ecs_http_stream_dropped(sub->stream));
+            flecs_json_array_push(buf);
+        }
+        sub->event_count ++;
+
+        flecs_json_next(buf);
+        flecs_json_object_push(buf);
+        flecs_json_member(buf, "entity");
+        flecs_json_path(buf, world, it->entities[i]);
+        ecs_strbuf_appendstr(buf, sub->last_id_json);
+        flecs_json_object_pop(buf);
+    }
+}
+
+static
+void rest_subscriber_free(
+    ecs_rest_subscriber_t *sub)
+{
+    ecs_world_t *world = sub->world;
+
+    /* When the world is being deleted observers are cleaned up by the world */
+    if (!ecs_is_fini(world)) {
+        int32_t i;
+        for (i = 0; i < sub->observer_count; i ++) {
+            ecs_delete(world, sub->observers[i]);
+        }
+    }
+
+    ecs_http_stream_close(sub->stream);
+    ecs_strbuf_reset(&sub->events);
+    ecs_os_free(sub->last_id_json);
+    ecs_os_free(sub);
+}
+
+/* Open event stream that pushes the entities for which one of the ids in the
+ * query was added. Events are collected with an observer per id, and sent to
+ * the client once per frame as a server-sent event. */
+static
+void rest_subscribe(
+    ecs_rest_ctx_t *impl,
+    const ecs_http_request_t* req,
+    ecs_http_reply_t *reply,
+    const char *q)
+{
+    ecs_world_t *world = impl->world;
+    ecs_filter_t f;
+
+    ecs_dbg_2("rest: subscribe to '%s'", q);
+    bool prev_color = ecs_log_enable_colors(false);
+    ecs_os_api_log_t prev_log_ = ecs_os_api.log_;
+    ecs_os_api.log_ = rest_capture_log;
+
+    if (ecs_filter_init(world, &f, &(ecs_filter_desc_t) { .expr = q })) {
+        char *err = rest_get_captured_log();
+        char *escaped_err = ecs_astresc('"', err);
+        reply_error(reply, escaped_err);
+        reply->code = 400; /* bad request */
+        ecs_os_free(escaped_err);
+        ecs_os_free(err);
+        goto done;
+    }
+
+    if (f.term_count > ECS_REST_STREAM_ID_MAX) {
+        reply_error(reply, "too many ids for event stream (max %d)",
+            ECS_REST_STREAM_ID_MAX);
+        reply->code = 400; /* bad request */
+        goto fini;
+    }
+
+    reply->content_type = "text/event-stream";
+    ecs_strbuf_appendstr(&reply->headers, "Cache-Control: no-cache\r\n");
+
+    ecs_http_stream_t *stream = ecs_http_stream_open(
+        req, reply, ECS_REST_STREAM_QUEUE_SIZE);
+    if (!stream) {
+        goto fini;
+    }
+
+    ecs_rest_subscriber_t *sub = ecs_os_calloc_t(ecs_rest_subscriber_t);
+    sub->world = world;
+    sub->stream = stream;
+
+    int32_t i;
+    for (i = 0; i < f.term_count; i ++) {
+        sub->observers[i] = ecs_observer_init(world, &(ecs_observer_desc_t) {
+            .filter.terms = {{ .id = f.terms[i].id }},
+            .events = { EcsOnAdd },
+            .callback = rest_stream_observer,
+            .ctx = sub
+        });
+        sub->observer_count ++;
+    }
+
+    ecs_rest_subscriber_t **elem = ecs_vector_add(
+        &impl->subscribers, ecs_rest_subscriber_t*);
+    *elem = sub;
+
+fini:
+    ecs_filter_fini(&f);
+done:
+    ecs_os_api.log_ = prev_log_;
+    ecs_log_enable_colors(prev_color);
+}
+
+/* Send events collected in the last frame to subscribers */
+static
+void rest_publish(
+    ecs_rest_ctx_t *impl,
+    FLECS_FLOAT delta_time)
+{
+    int32_t i, count = ecs_vector_count(impl->subscribers);
+    ecs_rest_subscriber_t **subs = ecs_vector_first(
+        impl->subscribers, ecs_rest_subscriber_t*);
+
+    for (i = count - 1; i >= 0; i --) {
+        ecs_rest_subscriber_t *sub = subs[i];
+        int res;
+
+        if (sub->event_count) {
+            flecs_json_array_pop(&sub->events);
+            ecs_strbuf_appendstr(&sub->events, "}\n\n");
+
+            ecs_size_t len = ecs_strbuf_written(&sub->events);
+            char *str = ecs_strbuf_get(&sub->events);
+            res = ecs_http_stream_send(sub->stream, str, len);
+            ecs_strbuf_reset(&sub->events);
+            ecs_os_free(str);
+
+            /* Names may change between frames, don't reuse serialized id */
+            ecs_os_free(sub->last_id_json);
+            sub->last_id_json = NULL;
+            sub->event_count = 0;
+            sub->idle_time = 0;
+        } else {
+            sub->idle_time += delta_time;
+            if (sub->idle_time > (FLECS_FLOAT)
+                ECS_REST_STREAM_KEEPALIVE_INTERVAL) 
+            {
+                res = ecs_http_stream_send(sub->stream, ": keepalive\n\n", 13);
+                sub->idle_time = 0;
+            } else {
+                res = ecs_http_stream_flush(sub->stream);
+            }
+        }
+
+        if (res == -1) {
+            rest_subscriber_free(sub);
+            ecs_vector_remove(impl->subscribers, ecs_rest_subscriber_t*, i);
+            subs = ecs_vector_first(impl->subscribers, ecs_rest_subscriber_t*);
+        }
+    }
+}
+
 static
 bool rest_reply(
     const ecs_http_request_t* req,
@@ -30979,6 +33274,9 @@ bool rest_reply(
                 return true;
             }
 
+            const char *format = ecs_http_get_param(req, "format");
+            bool binary = format && !ecs_os_strcmp(format, "binary");
+
             ecs_dbg_2("rest: request query '%s'", q);
             bool prev_color = ecs_log_enable_colors(false);
             ecs_os_api_log_t prev_log_ = ecs_os_api.log_;
@@ -30987,6 +33285,12 @@ bool rest_reply(
             ecs_rule_t *r = ecs_rule_init(world, &(ecs_filter_desc_t) {
                 .expr = q
             });
+
+            /* Only capture errors of the query parser. Errors that happen
+             * while the reply is streamed can't be added to the reply. */
+            ecs_os_api.log_ = prev_log_;
+            ecs_log_enable_colors(prev_color);
+
             if (!r) {
                 char *err = rest_get_captured_log();
                 char *escaped_err = ecs_astresc('"', err);
@@ -30994,25 +33298,83 @@ bool rest_reply(
                 reply->code = 400; /* bad request */
                 ecs_os_free(escaped_err);
                 ecs_os_free(err);
+            } else if (binary && ecs_rule_get_filter(r)->term_count > 
+                ECS_REST_BINARY_TERM_MAX) 
+            {
+                reply_error(reply, "too many terms for binary format (max %d)",
+                    ECS_REST_BINARY_TERM_MAX);
+                reply->code = 400; /* bad request */
+                ecs_rule_fini(r);
             } else {
                 ecs_iter_to_json_desc_t desc = ECS_ITER_TO_JSON_INIT;
                 rest_parse_json_ser_iter_params(&desc, req);
 
                 int32_t offset = 0;
                 int32_t limit = 100;
+                int32_t since = -1;
 
                 rest_int_param(req, "offset", &offset);
                 rest_int_param(req, "limit", &limit);
+                rest_int_param(req, "since", &since);
+
+                if (binary) {
+                    reply->content_type = "application/octet-stream";
+                }
+
+                /* Report the current tick, so that clients can pass it as the
+                 * 'since' parameter of the next request to only receive the
+                 * tables that changed in the meantime. Tables that change
+                 * during the current frame are reported again next time. */
+                ecs_strbuf_append(&reply->headers, "Flecs-Tick: %d\r\n", 
+                    ecs_get_world_info(world)->frame_count_total);
+                ecs_strbuf_appendstr(&reply->headers, 
+                    "Access-Control-Expose-Headers: Flecs-Tick\r\n");
+
+                /* Stream results to the client as they are serialized, so
+                 * that memory use is bounded by the chunk size and not by the
+                 * size of the result set. If the headers can't be sent the
+                 * connection is closed, and there is nothing to serialize. */
+                if (!ecs_http_reply_chunked(req, reply)) {
+                    ecs_iter_t it = ecs_rule_iter(world, r);
+                    ecs_iter_t cit, *src = &it;
+                    if (since >= 0) {
+                        cit = ecs_changed_iter(&it, since);
+                        src = &cit;
+                    }
+
+                    ecs_iter_t pit = ecs_page_iter(src, offset, limit);
+                    int res;
+                    if (binary) {
+                        res = rest_iter_to_binary_buf(
+                            world, &pit, &reply->body);
+                    } else {
+                        res = ecs_iter_to_json_buf(
+                            world, &pit, &reply->body, &desc);
+                    }
+
+                    /* The 200 status was already sent, so the only way to
+                     * report an error is to not complete the reply */
+                    if (res) {
+                        ecs_dbg("rest: failed to serialize query '%s'", q);
+                        ecs_http_reply_abort(reply);
+                    }
+                }
 
-                ecs_iter_t it = ecs_rule_iter(world, r);
-                ecs_iter_t pit = ecs_page_iter(&it, offset, limit);
-                ecs_iter_to_json_buf(world, &pit, &reply->body, &desc);
                 ecs_rule_fini(r);
             }
 
-            ecs_os_api.log_ = prev_log_;
-            ecs_log_enable_colors(prev_color);
+            return true;
+
+        /* Event stream endpoint */
+        } else if (!ecs_os_strcmp(req->path, "events")) {
+            const char *q = ecs_http_get_param(req, "q");
+            if (!q) {
+                ecs_strbuf_appendstr(&reply->body, "Missing parameter 'q'");
+                reply->code = 400; /* bad request */
+                return true;
+            }
 
+            rest_subscribe(impl, req, reply, q);
             return true;
         }
     }
@@ -31053,6 +33415,7 @@ void on_set_rest(ecs_iter_t *it)
         srv_ctx->world = it->world;
         srv_ctx->entity = it->entities[i];
         srv_ctx->srv = srv;
+        srv_ctx->subscribers = NULL;
         srv_ctx->rc = 1;
 
         rest[i].impl = srv_ctx;
@@ -31076,6 +33439,7 @@ void DequeueRest(ecs_iter_t *it) {
         ecs_rest_ctx_t *ctx = rest[i].impl;
         if (ctx) {
             ecs_http_server_dequeue(ctx->srv, it->delta_time);
+            rest_publish(ctx, it->delta_time);
         }
     } 
 }
@@ -31097,7 +33461,15 @@ void FlecsRestImport(
         .on_set = on_set_rest
     });
 
-    ECS_SYSTEM(world, DequeueRest, EcsPostFrame, EcsRest);
+    /* Not staged, as event streams create and delete observers */
+    ecs_system_init(world, &(ecs_system_desc_t) {
+        .entity = { .name = "DequeueRest", .add = { EcsPostFrame } },
+        .query.filter.terms = {
+            { .id = ecs_id(EcsRest) }
+        },
+        .callback = DequeueRest,
+        .no_staging = true
+    });
 }
 
 #endif
@@ -31289,6 +33661,7 @@ typedef SOCKET ecs_http_socket_t;
 #include <netdb.h>
 #include <strings.h>
 #include <signal.h>
+#include <fcntl.h>
 typedef int ecs_http_socket_t;
 #endif
 
@@ -31402,6 +33775,34 @@ typedef struct {
     void *res;
 } ecs_http_request_impl_t;
 
+/** Buffer for chunked replies. Content is collected until the buffer is full,
+ * after which it is sent as a single chunk. */
+typedef struct {
+    ecs_http_connection_impl_t *conn;
+    char buf[ECS_HTTP_SEND_RECV_BUFFER_SIZE];
+    ecs_size_t count;
+    bool failed;
+} ecs_http_chunk_buf_t;
+
+/** Stream that outlives the request it was opened for. Data is sent as chunks
+ * on a non-blocking socket. Chunks that can't be sent right away are stored in
+ * a bounded queue, so that a slow client can't stall the thread that pushes
+ * data to it. When the queue is full, new chunks are dropped. */
+struct ecs_http_stream_t {
+    ecs_http_socket_t sock;
+    char host[128];
+    char port[16];
+
+    char *queue;            /* Data that couldn't be sent yet */
+    ecs_size_t queue_size;  /* Allocated size of queue */
+    ecs_size_t queue_max;   /* Max number of bytes to queue */
+    ecs_size_t head;        /* Offset of first unsent byte in queue */
+    ecs_size_t count;       /* End of unsent data in queue */
+
+    int32_t dropped;        /* Number of chunks dropped because queue was full */
+    bool failed;            /* Set when the connection is no longer usable */
+};
+
 static
 ecs_size_t http_send(
     ecs_http_socket_t sock, 
@@ -31481,6 +33882,31 @@ void http_close(
 #endif
 }
 
+static
+int http_set_nonblocking(
+    ecs_http_socket_t sock)
+{
+#if defined(ECS_TARGET_WINDOWS)
+    u_long mode = 1;
+    return ioctlsocket(sock, FIONBIO, &mode);
+#else
+    int flags = fcntl(sock, F_GETFL, 0);
+    if (flags == -1) {
+        return -1;
+    }
+    return fcntl(sock, F_SETFL, flags | O_NONBLOCK);
+#endif
+}
+
+static
+bool http_would_block(void) {
+#if defined(ECS_TARGET_WINDOWS)
+    return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+    return errno == EAGAIN || errno == EWOULDBLOCK;
+#endif
+}
+
 static
 ecs_http_socket_t http_accept(
     ecs_http_socket_t sock,
@@ -31829,9 +34255,13 @@ void append_send_headers(
     ecs_strbuf_appendstr(hdrs, content_type);
     ecs_strbuf_appendstr(hdrs, "\r\n");
 
-    ecs_strbuf_appendstr(hdrs, "Content-Length: ");
-    ecs_strbuf_append(hdrs, "%d", content_len);
-    ecs_strbuf_appendstr(hdrs, "\r\n");
+    if (content_len >= 0) {
+        ecs_strbuf_appendstr(hdrs, "Content-Length: ");
+        ecs_strbuf_append(hdrs, "%d", content_len);
+        ecs_strbuf_appendstr(hdrs, "\r\n");
+    } else {
+        ecs_strbuf_appendstr(hdrs, "Transfer-Encoding: chunked\r\n");
+    }
 
     ecs_strbuf_appendstr(hdrs, "Server: flecs\r\n");
 
@@ -31841,9 +34271,10 @@ void append_send_headers(
 }
 
 static
-void send_reply(
+int send_headers(
     ecs_http_connection_impl_t* conn, 
-    ecs_http_reply_t* reply) 
+    ecs_http_reply_t* reply,
+    ecs_size_t content_length)
 {
     char hdrs[ECS_HTTP_REPLY_HEADER_SIZE];
     ecs_strbuf_t hdr_buf = ECS_STRBUF_INIT;
@@ -31851,10 +34282,6 @@ void send_reply(
     hdr_buf.max = ECS_HTTP_REPLY_HEADER_SIZE;
     hdr_buf.buf = hdrs;
 
-    char *content = ecs_strbuf_get(&reply->body);
-    int32_t content_length = reply->body.length - 1;
-
-    /* First, send the response HTTP headers */
     append_send_headers(&hdr_buf, reply->code, reply->status, 
         reply->content_type, &reply->headers, content_length);
 
@@ -31865,12 +34292,91 @@ void send_reply(
     if (written != hdrs_len) {
         ecs_err("failed to write HTTP response headers to '%s:%s': %s",
             conn->pub.host, conn->pub.port, ecs_os_strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+
+static
+void send_chunk(
+    ecs_http_chunk_buf_t *chunk,
+    const char *data,
+    ecs_size_t len)
+{
+    if (chunk->failed) {
+        return;
+    }
+
+    ecs_http_connection_impl_t *conn = chunk->conn;
+    char hdr[16];
+    ecs_size_t hdr_len = flecs_itoi32(
+        ecs_os_sprintf(hdr, "%x\r\n", (uint32_t)len));
+
+    if ((http_send(conn->sock, hdr, hdr_len, 0) != hdr_len) ||
+        (len && (http_send(conn->sock, data, len, 0) != len)) ||
+        (http_send(conn->sock, "\r\n", 2, 0) != 2))
+    {
+        ecs_err("failed to write HTTP response chunk to '%s:%s': %s",
+            conn->pub.host, conn->pub.port, ecs_os_strerror(errno));
+        chunk->failed = true;
+    }
+}
+
+static
+void flush_chunk(
+    const char *str,
+    int32_t len,
+    void *ctx)
+{
+    ecs_http_chunk_buf_t *chunk = ctx;
+    ecs_size_t avail = ECS_SIZEOF(chunk->buf) - chunk->count;
+
+    if (len > avail) {
+        if (chunk->count) {
+            send_chunk(chunk, chunk->buf, chunk->count);
+            chunk->count = 0;
+        }
+        if (len >= ECS_SIZEOF(chunk->buf)) {
+            /* Too large to buffer, send as a single chunk */
+            send_chunk(chunk, str, len);
+            return;
+        }
+    }
+
+    ecs_os_memcpy(&chunk->buf[chunk->count], str, len);
+    chunk->count += len;
+}
+
+static
+void send_reply(
+    ecs_http_connection_impl_t* conn, 
+    ecs_http_reply_t* reply) 
+{
+    if (reply->chunked) {
+        ecs_http_chunk_buf_t *chunk = reply->body.flush_ctx;
+        ecs_strbuf_flush(&reply->body);
+        if (chunk->count) {
+            send_chunk(chunk, chunk->buf, chunk->count);
+        }
+        send_chunk(chunk, NULL, 0); /* Terminating chunk */
+        ecs_os_free(chunk);
+        reply->body.flush = NULL;
+        reply->body.flush_ctx = NULL;
+        return;
+    }
+
+    char *content = ecs_strbuf_get(&reply->body);
+    int32_t content_length = reply->body.length - 1;
+
+    /* First, send the response HTTP headers */
+    if (send_headers(conn, reply, content_length)) {
         return;
     }
 
     /* Second, send response body */
     if (content_length > 0) {
-        written = http_send(conn->sock, content, content_length, 0);
+        ecs_size_t written = http_send(conn->sock, content, content_length, 0);
         if (written != content_length) {
             ecs_err("failed to write HTTP response body to '%s:%s': %s",
                 conn->pub.host, conn->pub.port, ecs_os_strerror(errno));
@@ -32090,8 +34596,12 @@ void handle_request(
         reply.status = "Resource not found";
     }
 
-    send_reply(conn, &reply);
-    ecs_dbg_2("http: reply sent to '%s:%s'", conn->pub.host, conn->pub.port);
+    /* If the socket was handed off to a stream there is nothing left to send */
+    if (conn->sock) {
+        send_reply(conn, &reply);
+        ecs_dbg_2("http: reply sent to '%s:%s'", 
+            conn->pub.host, conn->pub.port);
+    }
 
     reply_free(&reply);
     request_free(req);
@@ -32135,6 +34645,206 @@ int32_t dequeue_requests(
     return request_count;
 }
 
+int ecs_http_reply_chunked(
+    const ecs_http_request_t* req,
+    ecs_http_reply_t *reply)
+{
+    ecs_check(req != NULL, ECS_INVALID_PARAMETER, NULL);
+    ecs_check(reply != NULL, ECS_INVALID_PARAMETER, NULL);
+    ecs_check(!reply->chunked, ECS_INVALID_OPERATION, NULL);
+    ecs_check(!reply->body.elementCount, ECS_INVALID_OPERATION, NULL);
+
+    ecs_http_connection_impl_t *conn = (ecs_http_connection_impl_t*)req->conn;
+    if (send_headers(conn, reply, -1)) {
+        /* Headers may have been partially sent, so the connection can't be
+         * used for another reply */
+        http_close(conn->sock);
+        conn->sock = 0;
+        goto error;
+    }
+
+    ecs_http_chunk_buf_t *chunk = ecs_os_malloc_t(ecs_http_chunk_buf_t);
+    chunk->conn = conn;
+    chunk->count = 0;
+    chunk->failed = false;
+
+    reply->body.flush = flush_chunk;
+    reply->body.flush_ctx = chunk;
+    reply->chunked = true;
+
+    return 0;
+error:
+    return -1;
+}
+
+void ecs_http_reply_abort(
+    ecs_http_reply_t *reply)
+{
+    ecs_check(reply != NULL, ECS_INVALID_PARAMETER, NULL);
+    ecs_check(reply->chunked, ECS_INVALID_OPERATION, NULL);
+
+    /* A failed chunk buffer doesn't send anything, including the terminating
+     * chunk. The connection is closed after the reply, which lets the client
+     * know that the reply is incomplete. */
+    ecs_http_chunk_buf_t *chunk = reply->body.flush_ctx;
+    chunk->failed = true;
+error:
+    return;
+}
+
+ecs_http_stream_t* ecs_http_stream_open(
+    const ecs_http_request_t* req,
+    ecs_http_reply_t *reply,
+    ecs_size_t queue_size)
+{
+    ecs_check(req != NULL, ECS_INVALID_PARAMETER, NULL);
+    ecs_check(reply != NULL, ECS_INVALID_PARAMETER, NULL);
+    ecs_check(queue_size > 0, ECS_INVALID_PARAMETER, NULL);
+    ecs_check(!reply->chunked, ECS_INVALID_OPERATION, NULL);
+    ecs_check(!reply->body.elementCount, ECS_INVALID_OPERATION, NULL);
+
+    ecs_http_connection_impl_t *conn = (ecs_http_connection_impl_t*)req->conn;
+    if (send_headers(conn, reply, -1)) {
+        goto error_close;
+    }
+
+    if (http_set_nonblocking(conn->sock)) {
+        ecs_err("failed to make stream to '%s:%s' non-blocking: %s",
+            conn->pub.host, conn->pub.port, ecs_os_strerror(errno));
+        goto error_close;
+    }
+
+    ecs_http_stream_t *stream = ecs_os_calloc_t(ecs_http_stream_t);
+    stream->sock = conn->sock;
+    ecs_os_strcpy(stream->host, conn->pub.host);
+    ecs_os_strcpy(stream->port, conn->pub.port);
+    stream->queue = ecs_os_malloc(queue_size);
+    stream->queue_size = queue_size;
+    stream->queue_max = queue_size;
+
+    /* Stream now owns the socket, make sure it's not closed with connection */
+    conn->sock = 0;
+
+    ecs_dbg_2("http: stream opened to '%s:%s'", stream->host, stream->port);
+
+    return stream;
+error_close:
+    /* Headers were (partially) sent, don't send another reply */
+    http_close(conn->sock);
+    conn->sock = 0;
+error:
+    return NULL;
+}
+
+int ecs_http_stream_flush(
+    ecs_http_stream_t *stream)
+{
+    ecs_check(stream != NULL, ECS_INVALID_PARAMETER, NULL);
+
+    while (!stream->failed && (stream->head != stream->count)) {
+        ecs_size_t len = stream->count - stream->head;
+        ecs_size_t written = http_send(stream->sock, 
+            &stream->queue[stream->head], len, 0);
+        if (written > 0) {
+            stream->head += written;
+        } else if (written < 0 && http_would_block()) {
+            break; /* Client isn't reading fast enough, try again later */
+        } else {
+            ecs_dbg("http: stream to '%s:%s' closed: %s", 
+                stream->host, stream->port, ecs_os_strerror(errno));
+            stream->failed = true;
+        }
+    }
+
+    if (stream->head == stream->count) {
+        stream->head = stream->count = 0;
+    }
+
+    return stream->failed ? -1 : 0;
+error:
+    return -1;
+}
+
+int ecs_http_stream_send(
+    ecs_http_stream_t *stream,
+    const char *data,
+    ecs_size_t len)
+{
+    ecs_check(stream != NULL, ECS_INVALID_PARAMETER, NULL);
+    ecs_check(data != NULL, ECS_INVALID_PARAMETER, NULL);
+    ecs_check(len > 0, ECS_INVALID_PARAMETER, NULL);
+
+    if (ecs_http_stream_flush(stream)) {
+        return -1;
+    }
+
+    char hdr[16];
+    ecs_size_t hdr_len = flecs_itoi32(
+        ecs_os_sprintf(hdr, "%x\r\n", (uint32_t)len));
+    ecs_size_t chunk_len = hdr_len + len + 2;
+
+    /* Only queue entire chunks, so the client never receives partial data. 
+     * A chunk that is larger than the max queue size is accepted if nothing
+     * else is queued, as it would otherwise never be sent. */
+    ecs_size_t queued = stream->count - stream->head;
+    if (queued && ((queued + chunk_len) > stream->queue_max)) {
+        stream->dropped ++;
+        return 1;
+    }
+
+    if ((stream->count + chunk_len) > stream->queue_size) {
+        stream->count = queued;
+        ecs_os_memmove(stream->queue, &stream->queue[stream->head], queued);
+        stream->head = 0;
+        if ((queued + chunk_len) > stream->queue_size) {
+            stream->queue_size = queued + chunk_len;
+            stream->queue = ecs_os_realloc(stream->queue, stream->queue_size);
+        }
+    }
+
+    char *ptr = &stream->queue[stream->count];
+    ecs_os_memcpy(ptr, hdr, hdr_len);
+    ecs_os_memcpy(&ptr[hdr_len], data, len);
+    ecs_os_memcpy(&ptr[hdr_len + len], "\r\n", 2);
+    stream->count += chunk_len;
+
+    return ecs_http_stream_flush(stream);
+error:
+    return -1;
+}
+
+int32_t ecs_http_stream_dropped(
+    const ecs_http_stream_t *stream)
+{
+    ecs_check(stream != NULL, ECS_INVALID_PARAMETER, NULL);
+    return stream->dropped;
+error:
+    return 0;
+}
+
+void ecs_http_stream_close(
+    ecs_http_stream_t *stream)
+{
+    ecs_check(stream != NULL, ECS_INVALID_PARAMETER, NULL);
+
+    if (!stream->failed) {
+        /* Send terminating chunk. Don't block on a slow client, if it can't
+         * be sent the client sees the connection close without it. */
+        ecs_http_stream_flush(stream);
+        if (!stream->failed && !stream->count) {
+            http_send(stream->sock, "0\r\n\r\n", 5, 0);
+        }
+    }
+
+    ecs_dbg_2("http: stream to '%s:%s' closed", stream->host, stream->port);
+
+    http_close(stream->sock);
+    ecs_os_free(stream->queue);
+    ecs_os_free(stream);
+error:
+    return;
+}
+
 const char* ecs_http_get_header(
     const ecs_http_request_t* req,
     const char* name) 
@@ -34532,6 +37242,7 @@ const ecs_entity_t EcsPanic =                 ECS_HI_COMPONENT_ID + 52;
 
 /* Misc */
 const ecs_entity_t EcsDefaultChildComponent = ECS_HI_COMPONENT_ID + 55;
+const ecs_entity_t EcsToggle =                ECS_HI_COMPONENT_ID + 56;
 
 /* Systems */
 const ecs_entity_t EcsMonitor =               ECS_HI_COMPONENT_ID + 61;
@@ -34834,6 +37545,8 @@ void init_store(
     flecs_sparse_init(&world->store.entity_index, ecs_record_t);
     flecs_sparse_set_id_source(&world->store.entity_index, 
         &world->info.last_id);
+    flecs_sparse_set_chunk_bits(&world->store.entity_index, 
+        FLECS_ENTITY_CHUNK_BITS);
 
     /* Initialize root table */
     flecs_sparse_init(&world->store.tables, ecs_table_t);
@@ -35072,6 +37785,7 @@ ecs_world_t *ecs_mini(void) {
     world->fini_tasks = ecs_vector_new(ecs_entity_t, 0);
     flecs_name_index_init(&world->aliases);
     flecs_name_index_init(&world->symbols);
+    flecs_path_cache_init(world);
     ecs_map_init(&world->type_handles, ecs_entity_t, 0);
 
     world->info.time_scale = 1.0;
@@ -35625,6 +38339,7 @@ int ecs_fini(
 
     flecs_name_index_fini(&world->aliases);
     flecs_name_index_fini(&world->symbols);
+    flecs_path_cache_fini(world);
     
     fini_misc(world);
 
@@ -36071,6 +38786,8 @@ void ecs_frame_end(
         ecs_os_mutex_unlock(world->thr_sync);
     }
 
+    flecs_collect_empty_tables(world);
+
     stop_measure_frame(world);
 error:
     return;
@@ -36195,9 +38912,9 @@ void flecs_table_set_empty(
     ecs_poly_assert(world, ecs_world_t);
     ecs_assert(!world->is_readonly, ECS_INTERNAL_ERROR, NULL);
 
-    if (ecs_table_count(table)) {
-        table->generation = 0;
-    }
+    /* Table changed from empty to non-empty or vice versa. Reset generation,
+     * which counts the number of frames that a table was collectable. */
+    table->generation = 0;
 
     flecs_sparse_set_generation(world->pending_tables, (uint32_t)table->id);
     flecs_sparse_ensure(world->pending_tables, ecs_table_t*, 
@@ -36300,6 +39017,156 @@ done:
     return delete_count;
 }
 
+void ecs_set_empty_table_gc(
+    ecs_world_t *world,
+    uint16_t clear_generation,
+    uint16_t delete_generation,
+    double time_budget_seconds)
+{
+    ecs_poly_assert(world, ecs_world_t);
+    ecs_check(time_budget_seconds >= 0, ECS_INVALID_PARAMETER, NULL);
+
+    world->gc_clear_generation = clear_generation;
+    world->gc_delete_generation = delete_generation;
+    world->gc_time_budget = time_budget_seconds;
+error:
+    return;
+}
+
+static
+void reserve_tables(
+    ecs_world_t *world,
+    ecs_table_cache_iter_t *it,
+    int32_t count)
+{
+    ecs_table_record_t *tr;
+    while ((tr = flecs_table_cache_next(it, ecs_table_record_t))) {
+        ecs_table_t *table = tr->hdr.table;
+        if (table->reserved < count) {
+            table->reserved = count;
+        }
+        if (ecs_table_count(table)) {
+            flecs_table_set_size(world, table, &table->data, count);
+        }
+    }
+}
+
+void ecs_reserve_id(
+    ecs_world_t *world,
+    ecs_id_t id,
+    int32_t count)
+{
+    ecs_poly_assert(world, ecs_world_t);
+    ecs_check(count >= 0, ECS_INVALID_PARAMETER, NULL);
+    ecs_check(!world->is_readonly, ECS_INVALID_OPERATION, NULL);
+
+    ecs_id_record_t *idr = flecs_ensure_id_record(world, id);
+    idr->reserve = count;
+
+    /* Empty tables are resized when the first entity is added */
+    ecs_table_cache_iter_t it;
+    if (flecs_table_cache_iter(&idr->cache, &it)) {
+        reserve_tables(world, &it, count);
+    }
+    if (flecs_table_cache_empty_iter(&idr->cache, &it)) {
+        reserve_tables(world, &it, count);
+    }
+error:
+    return;
+}
+
+void flecs_collect_empty_tables(
+    ecs_world_t *world)
+{
+    uint16_t clear_generation = world->gc_clear_generation;
+    uint16_t delete_generation = world->gc_delete_generation;
+    if (!clear_generation && !delete_generation) {
+        return;
+    }
+
+    /* Make sure table counts reflect the operations of the last frame */
+    ecs_run_aperiodic(world, EcsAperiodicEmptyTableEvents);
+
+    ecs_sparse_t *tables = &world->store.tables;
+    double time_budget = world->gc_time_budget;
+    ecs_time_t start = {0}, cur;
+    int32_t i = world->gc_cursor, visited, delete_count = 0;
+
+    /* Don't count the dummy table at index 0 */
+    int32_t count = flecs_sparse_count(tables) - 1;
+
+    if (time_budget != 0) {
+        ecs_time_measure(&start);
+    }
+
+    /* Continue where the previous frame stopped. A frame visits no more tables
+     * than there are in the store, so that the generation of an empty table
+     * approximates the number of frames it has been empty for. */
+    for (visited = 0; visited < count; visited ++) {
+        if (time_budget != 0 && !(visited & 15)) {
+            cur = start;
+            if (ecs_time_measure(&cur) > time_budget) {
+                break;
+            }
+        }
+
+        if (i < 1 || i >= flecs_sparse_count(tables)) {
+            i = 1;
+        }
+
+        ecs_table_t *table = flecs_sparse_get_dense(tables, ecs_table_t, i);
+        int32_t row_count = ecs_table_count(table);
+        if (row_count) {
+            /* Shrink tables that used less than a quarter of their storage for
+             * more than clear_generation frames. Waiting before shrinking
+             * prevents reallocs for tables of which the size oscillates. */
+            uint16_t gen = 0;
+            if (clear_generation && 
+                row_count <= (table->data.entities.size >> 2)) 
+            {
+                gen = table->generation + 1;
+                if (gen > clear_generation) {
+                    flecs_table_shrink(world, table);
+                    gen = 0;
+                }
+            }
+            table->generation = gen;
+            i ++;
+            continue;
+        }
+
+        if (table->refcount > 1) {
+            /* Don't collect claimed tables */
+            i ++;
+            continue;
+        }
+
+        uint16_t gen = table->generation;
+        if (gen != UINT16_MAX) {
+            table->generation = ++ gen;
+        }
+
+        if (delete_generation && (gen > delete_generation)) {
+            if (flecs_table_release(world, table)) {
+                /* The last table in the sparse set is moved to the index of
+                 * the deleted table, so don't advance the cursor. */
+                delete_count ++;
+                continue;
+            }
+        } else if (clear_generation && (gen > clear_generation)) {
+            flecs_table_shrink(world, table);
+        }
+
+        i ++;
+    }
+
+    world->gc_cursor = i;
+
+    if (delete_count) {
+        ecs_dbg_2("#[red]collected#[normal] %d empty tables", delete_count);
+    }
+}
+
 
 void flecs_observable_init(
     ecs_observable_t *observable)
@@ -36437,7 +39304,12 @@ void flecs_emit(
             ecs_pair(relation, EcsWildcard));
     }
 
-    if (count && !desc->table_event) {
+    /* Only entities used as object of an acyclic relation can forward the
+     * event to other tables, and only SuperSet/SubSet triggers listen for
+     * forwarded events. When there are none, don't scan the rows. */
+    if (count && !desc->table_event && 
+        flecs_set_triggers_exist(observable, event)) 
+    {
         ecs_record_t **recs = ecs_storage_get_t(
             &table->data.records, ecs_record_t*, row);
 
@@ -36609,7 +39481,7 @@ int finalize_term_var(
             if (oneof && identifier != &term->pred) {
                 if (!e) {
                     e = ecs_lookup_child(world, oneof, identifier->name);
-                } else if (e) {
+                } else if (e != EcsWildcard && e != EcsAny) {
                     if (!ecs_has_pair(world, e, EcsChildOf, oneof)) {
                         char *rel_str = ecs_get_fullpath(world, pred);
                         term_error(world, term, name, 
@@ -38010,7 +40882,19 @@ bool flecs_term_match_table(
         if (match_index_out) {
             match_index_out[0] = 1;
         }
-        result = !result;
+
+        /* A pair with a union relation matches all cases of the relation in
+         * the table type. Don't exclude the table for Not terms, as it may
+         * have entities with other cases. These are filtered out by queries
+         * while iterating the case lists of the table. */
+        if (result && !source && ECS_HAS_ROLE(id, PAIR) && 
+            !ecs_id_is_wildcard(id) && 
+            ECS_PAIR_FIRST(match_table->type.array[column]) == EcsUnion)
+        {
+            column = -1;
+        } else {
+            result = !result;
+        }
     }
 
     if (oper == EcsOptional) {
@@ -40866,7 +43750,13 @@ void get_dirty_state(
 
     out->dirty_state = flecs_table_get_dirty_state(out->table);
 
-    if (column) {
+    ecs_table_t *table = out->table;
+    if (column > table->sw_offset && 
+        column <= (table->sw_offset + table->sw_count)) 
+    {
+        /* Union columns are tracked after the regular columns */
+        out->column = table->storage_count + column - 1 - table->sw_offset;
+    } else if (column) {
         out->column = ecs_table_type_to_storage_index(out->table, column - 1);
     } else {
         out->column = -1;
@@ -41095,6 +43985,25 @@ void init_query_monitors(
     }
 }
 
+/* The default group by function returns the object of the (group_by_id, *)
+ * relation in the table type. */
+static
+uint64_t group_by_relation(
+    ecs_world_t *world,
+    ecs_table_t *table,
+    ecs_id_t id,
+    void *ctx)
+{
+    (void)ctx;
+
+    ecs_id_t match;
+    if (ecs_search(world, table, ecs_pair(id, EcsWildcard), &match) != -1) {
+        return ECS_PAIR_SECOND(match);
+    }
+
+    return 0;
+}
+
 /* The group by function for cascade computes the tree depth for the table type.
  * This causes tables in the query cache to be ordered by depth, which ensures
  * breadth-first iteration order. */
@@ -41224,6 +44133,19 @@ void set_table_match(
                 
                 int32_t actual_index = terms[i].index;
                 int32_t column = it->columns[actual_index];
+                bool is_not = terms[i].oper == EcsNot;
+
+                if (is_not) {
+                    /* A table with a union relation doesn't have the pair in
+                     * its type, so the Not term matched. Exclude entities
+                     * that have the case while iterating. */
+                    if (!ECS_HAS_ROLE(id, PAIR)) {
+                        continue;
+                    }
+                    column = 1 + ecs_search(world, table, 
+                        ecs_pair(EcsUnion, ECS_PAIR_FIRST(id)), 0);
+                }
+
                 if (column <= 0) {
                     continue;
                 }
@@ -41236,9 +44158,13 @@ void set_table_match(
                 flecs_switch_term_t *sc = ecs_vector_add(
                      &qm->sparse_columns, flecs_switch_term_t);
                 sc->signature_column_index = actual_index;
+                sc->sw_index = column - 1 - table->sw_offset;
                 sc->sw_case = ECS_PAIR_SECOND(id);
                 sc->sw_column = NULL;
-                qm->ids[actual_index] = id;
+                sc->sw_not = is_not;
+                if (!is_not) {
+                    qm->ids[actual_index] = id;
+                }
             }
         }
         if (table->flags & EcsTableHasDisabled) {
@@ -41247,6 +44173,14 @@ void set_table_match(
                     continue;
                 }
 
+                /* Only And terms on this can exclude rows. A disabled component
+                 * doesn't hide an entity from an Optional or Not term. */
+                if (terms[i].oper != EcsAnd || 
+                    terms[i].subj.entity != EcsThis) 
+                {
+                    continue;
+                }
+
                 int32_t actual_index = terms[i].index;
                 ecs_id_t id = it->ids[actual_index];
                 ecs_id_t bs_id = ECS_DISABLED | (id & ECS_COMPONENT_MASK);
@@ -41439,6 +44373,10 @@ void qsort_array(
     qsort_array(world, table, data, entities, ptr, size, p + 1, hi, compare); 
 }
 
+/* Max number of out of order rows for which a table is sorted by moving rows
+ * into place instead of with quicksort */
+#define ECS_SORT_INSERTION_MAX (8)
+
 static
 void sort_table(
     ecs_world_t *world,
@@ -41468,7 +44406,41 @@ void sort_table(
         ptr = ecs_storage_first(column);
     }
 
-    qsort_array(world, table, data, entities, ptr, size, 0, count - 1, compare);
+    /* A table is usually sorted again after a few of its rows changed, so
+     * check whether rows are out of order before sorting. */
+    int32_t i, j, unsorted = 0;
+    for (i = 1; i < count; i ++) {
+        if (compare(entities[i - 1], ECS_ELEM(ptr, size, i - 1), 
+            entities[i], ECS_ELEM(ptr, size, i)) > 0) 
+        {
+            if (++ unsorted > ECS_SORT_INSERTION_MAX) {
+                break;
+            }
+        }
+    }
+
+    if (!unsorted) {
+        return;
+    }
+
+    if (unsorted > ECS_SORT_INSERTION_MAX) {
+        qsort_array(
+            world, table, data, entities, ptr, size, 0, count - 1, compare);
+        return;
+    }
+
+    /* Only a few rows are out of order, move them into place */
+    for (i = 1; i < count; i ++) {
+        for (j = i; j > 0; j --) {
+            if (compare(entities[j - 1], ECS_ELEM(ptr, size, j - 1), 
+                entities[j], ECS_ELEM(ptr, size, j)) <= 0) 
+            {
+                break;
+            }
+
+            flecs_table_swap(world, table, data, j - 1, j);
+        }
+    }
 }
 
 /* Helper struct for building sorted table ranges */
@@ -41507,165 +44479,344 @@ ecs_entity_t e_from_helper(
     }
 }
 
+/* Initialize helper with the rows of a matched table */
 static
-void build_sorted_table_range(
+void init_sort_helper(
     ecs_query_t *query,
-    ecs_query_table_list_t *list)
+    ecs_query_table_match_t *match,
+    sort_helper_t *helper)
 {
     ecs_world_t *world = query->world;
     ecs_entity_t id = query->order_by_component;
-    ecs_order_by_action_t compare = query->order_by;
-    
-    if (!list->count) {
-        return;
+    ecs_table_t *table = match->table;
+    ecs_data_t *data = &table->data;
+
+    ecs_assert(ecs_table_count(table) != 0, ECS_INTERNAL_ERROR, NULL);
+
+    int32_t index = -1;
+    if (id) {
+        index = ecs_search(world, table->storage_table, id, 0);
     }
 
-    int to_sort = 0;
+    if (index != -1) {
+        ecs_type_info_t *ti = table->type_info[index];
+        ecs_column_t *column = &data->columns[index];
+        int32_t size = ti->size;
+        helper->ptr = ecs_storage_first(column);
+        helper->elem_size = size;
+        helper->shared = false;
+    } else if (id) {
+        /* Find component in prefab */
+        ecs_entity_t base = 0;
+        ecs_search_relation(world, table, 0, id, 
+            EcsIsA, 1, 0, &base, 0, 0, 0);
+
+        /* If a base was not found, the query should not have allowed using
+         * the component for sorting */
+        ecs_assert(base != 0, ECS_INTERNAL_ERROR, NULL);
+
+        const EcsComponent *cptr = ecs_get(world, id, EcsComponent);
+        ecs_assert(cptr != NULL, ECS_INTERNAL_ERROR, NULL);
 
-    sort_helper_t *helper = ecs_os_malloc_n(sort_helper_t, list->count);
-    ecs_query_table_node_t *cur, *end = list->last->next;
-    for (cur = list->first; cur != end; cur = cur->next) {
-        ecs_query_table_match_t *match = cur->match;
-        ecs_table_t *table = match->table;
-        ecs_data_t *data = &table->data;
+        helper->ptr = ecs_get_id(world, base, id);
+        helper->elem_size = cptr->size;
+        helper->shared = true;
+    } else {
+        helper->ptr = NULL;
+        helper->elem_size = 0;
+        helper->shared = false;
+    }
 
-        ecs_assert(ecs_table_count(table) != 0, ECS_INTERNAL_ERROR, NULL);
+    helper->match = match;
+    helper->entities = ecs_storage_first(&data->entities);
+    helper->row = 0;
+    helper->count = ecs_table_count(table);
+}
 
-        int32_t index = -1;
-        if (id) {
-            index = ecs_search(world, table->storage_table, id, 0);
+/* Compare the current rows of two helpers. Groups are iterated in order of
+ * their id, so rows are ordered by group first. */
+static
+int compare_helpers(
+    ecs_order_by_action_t compare,
+    sort_helper_t *h1,
+    sort_helper_t *h2)
+{
+    uint64_t g1 = h1->match->group_id, g2 = h2->match->group_id;
+    if (g1 != g2) {
+        return (g1 > g2) - (g1 < g2);
+    }
+
+    return compare(e_from_helper(h1), ptr_from_helper(h1), 
+        e_from_helper(h2), ptr_from_helper(h2));
+}
+
+/* Find the first row of a helper that sorts after the current row of another
+ * helper. If inclusive is true, rows that are equal are also skipped. The rows
+ * of a table are sorted, so this can use a binary search. When tables are
+ * interleaved the bound is often close to the current row, so the range is
+ * first narrowed down with an exponential search. */
+static
+int32_t helper_upper_bound(
+    ecs_order_by_action_t compare,
+    sort_helper_t *helper,
+    sort_helper_t *other,
+    bool inclusive)
+{
+    int32_t row = helper->row, lo = row, hi = helper->count, step = 1;
+
+    while ((lo + step) < hi) {
+        helper->row = lo + step;
+        int cmp = compare_helpers(compare, helper, other);
+        if (cmp > 0 || (!cmp && !inclusive)) {
+            hi = helper->row;
+            break;
         }
+        lo = helper->row;
+        step *= 2;
+    }
 
-        if (index != -1) {
-            ecs_type_info_t *ti = table->type_info[index];
-            ecs_column_t *column = &data->columns[index];
-            int32_t size = ti->size;
-            helper[to_sort].ptr = ecs_storage_first(column);
-            helper[to_sort].elem_size = size;
-            helper[to_sort].shared = false;
-        } else if (id) {
-            /* Find component in prefab */
-            ecs_entity_t base = 0;
-            ecs_search_relation(world, table, 0, id, 
-                EcsIsA, 1, 0, &base, 0, 0, 0);
-
-            /* If a base was not found, the query should not have allowed using
-             * the component for sorting */
-            ecs_assert(base != 0, ECS_INTERNAL_ERROR, NULL);
-
-            const EcsComponent *cptr = ecs_get(world, id, EcsComponent);
-            ecs_assert(cptr != NULL, ECS_INTERNAL_ERROR, NULL);
-
-            helper[to_sort].ptr = ecs_get_id(world, base, id);
-            helper[to_sort].elem_size = cptr->size;
-            helper[to_sort].shared = true;
+    while (lo < hi) {
+        helper->row = lo + (hi - lo) / 2;
+        int cmp = compare_helpers(compare, helper, other);
+        if (cmp < 0 || (!cmp && inclusive)) {
+            lo = helper->row + 1;
         } else {
-            helper[to_sort].ptr = NULL;
-            helper[to_sort].elem_size = 0;
-            helper[to_sort].shared = false;
+            hi = helper->row;
         }
+    }
+
+    helper->row = row;
+
+    return lo;
+}
 
-        helper[to_sort].match = match;
-        helper[to_sort].entities = ecs_storage_first(&data->entities);
-        helper[to_sort].row = 0;
-        helper[to_sort].count = ecs_table_count(table);
-        to_sort ++;      
+/* Binary heap of helpers, ordered by their current row. Equal rows are ordered
+ * by helper index, which is the order of tables in the query. */
+typedef struct sort_heap_t {
+    ecs_order_by_action_t compare;
+    sort_helper_t *helpers;
+    int32_t *elems;
+    int32_t count;
+} sort_heap_t;
+
+static
+bool sort_heap_less(
+    sort_heap_t *heap,
+    int32_t h1,
+    int32_t h2)
+{
+    int cmp = compare_helpers(
+        heap->compare, &heap->helpers[h1], &heap->helpers[h2]);
+    if (cmp) {
+        return cmp < 0;
     }
 
-    ecs_assert(to_sort != 0, ECS_INTERNAL_ERROR, NULL);
+    return h1 < h2;
+}
 
-    bool proceed;
-    do {
-        int32_t j, min = 0;
-        proceed = true;
-
-        ecs_entity_t e1;
-        while (!(e1 = e_from_helper(&helper[min]))) {
-            min ++;
-            if (min == to_sort) {
-                proceed = false;
-                break;
-            }
-        }
+static
+void sort_heap_down(
+    sort_heap_t *heap,
+    int32_t i)
+{
+    int32_t *elems = heap->elems, count = heap->count;
 
-        if (!proceed) {
+    for (;;) {
+        int32_t min = i, left = 2 * i + 1, right = left + 1;
+        if (left < count && sort_heap_less(heap, elems[left], elems[min])) {
+            min = left;
+        }
+        if (right < count && sort_heap_less(heap, elems[right], elems[min])) {
+            min = right;
+        }
+        if (min == i) {
             break;
         }
 
-        for (j = min + 1; j < to_sort; j++) {
-            ecs_entity_t e2 = e_from_helper(&helper[j]);
-            if (!e2) {
-                continue;
-            }
+        int32_t tmp = elems[i];
+        elems[i] = elems[min];
+        elems[min] = tmp;
+        i = min;
+    }
+}
 
-            const void *ptr1 = ptr_from_helper(&helper[min]);
-            const void *ptr2 = ptr_from_helper(&helper[j]);
+/* Append rows of a table to the sorted slices. Rows that follow the last slice
+ * of the same table are added to that slice. */
+static
+void add_table_slice(
+    ecs_vector_t **slices,
+    ecs_query_table_match_t *match,
+    int32_t offset,
+    int32_t count)
+{
+    ecs_query_table_node_t *last = ecs_vector_last(
+        *slices, ecs_query_table_node_t);
+    if (last && last->match == match && (last->offset + last->count) == offset) {
+        last->count += count;
+        return;
+    }
 
-            if (compare(e1, ptr1, e2, ptr2) > 0) {
-                min = j;
-                e1 = e_from_helper(&helper[min]);
-            }
-        }
+    ecs_query_table_node_t *node = ecs_vector_add(
+        slices, ecs_query_table_node_t);
+    ecs_assert(node != NULL, ECS_INTERNAL_ERROR, NULL);
+    node->match = match;
+    node->offset = offset;
+    node->count = count;
+}
 
-        sort_helper_t *cur_helper = &helper[min];
-        if (!cur || cur->match != cur_helper->match) {
-            cur = ecs_vector_add(&query->table_slices, ecs_query_table_node_t);
-            ecs_assert(cur != NULL, ECS_INTERNAL_ERROR, NULL);
-            cur->match = cur_helper->match;
-            cur->offset = cur_helper->row;
-            cur->count = 1;
-        } else {
-            cur->count ++;
+/* Append the rows of the table at the top of the heap to the sorted slices,
+ * until the table no longer has the smallest row. If limit is provided, only
+ * rows that sort before limit are added. */
+static
+void sort_heap_pop(
+    sort_heap_t *heap,
+    sort_helper_t *limit,
+    ecs_vector_t **slices)
+{
+    int32_t top = heap->elems[0];
+    sort_helper_t *helper = &heap->helpers[top];
+    int32_t end = helper->count;
+
+    if (heap->count > 1) {
+        /* Find the next smallest table, which is one of the children */
+        int32_t next = heap->elems[1];
+        if (heap->count > 2 && sort_heap_less(heap, heap->elems[2], next)) {
+            next = heap->elems[2];
         }
 
-        cur_helper->row ++;
-    } while (proceed);
+        end = helper_upper_bound(heap->compare, helper, 
+            &heap->helpers[next], top < next);
+    }
 
-    /* Iterate through the vector of slices to set the prev/next ptrs. This
-     * can't be done while building the vector, as reallocs may occur */
-    int32_t i, count = ecs_vector_count(query->table_slices);    
-    ecs_query_table_node_t *nodes = ecs_vector_first(
-        query->table_slices, ecs_query_table_node_t);
-    for (i = 0; i < count; i ++) {
-        nodes[i].prev = &nodes[i - 1];
-        nodes[i].next = &nodes[i + 1];
+    if (limit) {
+        int32_t limit_end = helper_upper_bound(
+            heap->compare, helper, limit, false);
+        if (limit_end < end) {
+            end = limit_end;
+        }
     }
 
-    nodes[0].prev = NULL;
-    nodes[i - 1].next = NULL;
+    ecs_assert(end > helper->row, ECS_INTERNAL_ERROR, NULL);
+    add_table_slice(slices, helper->match, helper->row, end - helper->row);
+    helper->row = end;
+
+    if (helper->row == helper->count) {
+        heap->elems[0] = heap->elems[-- heap->count];
+    }
 
-    ecs_os_free(helper);
+    if (heap->count) {
+        sort_heap_down(heap, 0);
+    }
 }
 
+/* Build the list of sorted table slices. The rows of each table are sorted, so
+ * tables are combined with a k-way merge. If only some tables changed since the
+ * last build, the slices of unchanged tables are reused, and only the rows of
+ * changed tables are merged in. */
 static
 void build_sorted_tables(
-    ecs_query_t *query)
+    ecs_query_t *query,
+    bool rebuild)
 {
-    ecs_vector_clear(query->table_slices);
+    ecs_vector_t *prev_slices = query->table_slices;
+    ecs_vector_t *slices = NULL;
+    int32_t i, count = query->list.count;
 
-    if (query->group_by) {
-        /* Populate sorted node list in grouping order */
-        ecs_query_table_node_t *cur = query->list.first;
-        if (cur) {
-            do {
-                /* Find list for current group */
-                ecs_query_table_match_t *match = cur->match;
-                ecs_assert(match != NULL, ECS_INTERNAL_ERROR, NULL);
-                uint64_t group_id = match->group_id;
-                ecs_query_table_list_t *list = ecs_map_get(&query->groups, 
-                    ecs_query_table_list_t, group_id);
-                ecs_assert(list != NULL, ECS_INTERNAL_ERROR, NULL);
-
-                /* Sort tables in current group */
-                build_sorted_table_range(query, list);
-                
-                /* Find next group to sort */
-                cur = list->last->next;
-            } while (cur);
+    sort_helper_t *helpers = ecs_os_malloc_n(sort_helper_t, count + 1);
+    int32_t *elems = ecs_os_malloc_n(int32_t, count + 1);
+
+    sort_heap_t heap = {
+        .compare = query->order_by,
+        .helpers = helpers,
+        .elems = elems,
+        .count = 0
+    };
+
+    /* Helpers are created in query order, so that equal rows are ordered by
+     * the position of their table in the query. Only tables that changed are
+     * added to the heap. */
+    ecs_query_table_node_t *cur;
+    for (i = 0, cur = query->list.first; cur != NULL; i ++, cur = cur->next) {
+        ecs_query_table_match_t *match = cur->match;
+        init_sort_helper(query, match, &helpers[i]);
+        match->sort_helper = i;
+
+        if (rebuild || match->sort_dirty) {
+            elems[heap.count ++] = i;
         }
-    } else {
-        build_sorted_table_range(query, &query->list);
     }
+
+    ecs_assert(i == count, ECS_INTERNAL_ERROR, NULL);
+
+    for (i = heap.count / 2 - 1; i >= 0; i --) {
+        sort_heap_down(&heap, i);
+    }
+
+    if (!rebuild) {
+        /* Merge changed tables with slices of unchanged tables */
+        ecs_query_table_node_t *nodes = ecs_vector_first(
+            prev_slices, ecs_query_table_node_t);
+        int32_t node_count = ecs_vector_count(prev_slices);
+        sort_helper_t unchanged;
+
+        for (i = 0; i < node_count; i ++) {
+            ecs_query_table_node_t *node = &nodes[i];
+            if (node->match->sort_dirty) {
+                continue;
+            }
+
+            unchanged = helpers[node->match->sort_helper];
+            unchanged.row = node->offset;
+            unchanged.count = node->offset + node->count;
+
+            while (unchanged.row < unchanged.count) {
+                while (heap.count && compare_helpers(query->order_by, 
+                    &helpers[elems[0]], &unchanged) < 0)
+                {
+                    sort_heap_pop(&heap, &unchanged, &slices);
+                }
+
+                int32_t end = unchanged.count;
+                if (heap.count) {
+                    end = helper_upper_bound(query->order_by, &unchanged, 
+                        &helpers[elems[0]], true);
+                }
+
+                add_table_slice(&slices, node->match, unchanged.row, 
+                    end - unchanged.row);
+                unchanged.row = end;
+            }
+        }
+    }
+
+    while (heap.count) {
+        sort_heap_pop(&heap, NULL, &slices);
+    }
+
+    for (i = 0; i < count; i ++) {
+        helpers[i].match->sort_dirty = false;
+    }
+
+    ecs_os_free(helpers);
+    ecs_os_free(elems);
+    ecs_vector_free(prev_slices);
+
+    /* Iterate through the vector of slices to set the prev/next ptrs. This
+     * can't be done while building the vector, as reallocs may occur */
+    int32_t slice_count = ecs_vector_count(slices);
+    ecs_query_table_node_t *nodes = ecs_vector_first(
+        slices, ecs_query_table_node_t);
+    for (i = 0; i < slice_count; i ++) {
+        nodes[i].prev = &nodes[i - 1];
+        nodes[i].next = &nodes[i + 1];
+    }
+
+    if (slice_count) {
+        nodes[0].prev = NULL;
+        nodes[i - 1].next = NULL;
+    }
+
+    query->table_slices = slices;
 }
 
 static
@@ -41703,7 +44854,7 @@ void sort_tables(
     /* Iterate over non-empty tables. Don't bother with empty tables as they
      * have nothing to sort */
 
-    bool tables_sorted = false;
+    bool tables_changed = false;
 
     ecs_table_cache_iter_t it;
     ecs_query_table_t *qt;
@@ -41718,24 +44869,22 @@ void sort_tables(
         }
 
         int32_t column = -1;
+        bool sort = dirty;
         if (order_by_component) {
             if (check_table_monitor(query, qt, order_by_term + 1)) {
                 dirty = true;
             }
 
+            sort = false;
             if (dirty) {
-                column = -1;
-
                 ecs_table_t *storage_table = table->storage_table;
                 if (storage_table) {
                     column = ecs_search(world, storage_table, 
                         order_by_component, NULL);
                 }
 
-                if (column == -1) {
-                    /* Component is shared, no sorting is needed */
-                    dirty = false;
-                }
+                /* If the component is shared, no sorting is needed */
+                sort = column != -1;
             }
         }
 
@@ -41744,12 +44893,25 @@ void sort_tables(
         }
 
         /* Something has changed, sort the table */
-        sort_table(world, table, column, compare);
-        tables_sorted = true;
+        if (sort) {
+            sort_table(world, table, column, compare);
+        }
+
+        /* Rows of the table need to be merged again */
+        ecs_query_table_match_t *cur, *end = qt->last->next_match;
+        for (cur = qt->first; cur != end; cur = cur->next_match) {
+            cur->sort_dirty = true;
+        }
+
+        tables_changed = true;
     }
 
-    if (tables_sorted || query->match_count != query->prev_match_count) {
-        build_sorted_tables(query);
+    /* If the set of tables changed, rebuild the slices from scratch */
+    bool rebuild = query->match_count != query->prev_match_count ||
+        (!query->table_slices && query->list.count);
+
+    if (tables_changed || rebuild) {
+        build_sorted_tables(query, rebuild);
         query->match_count ++; /* Increase version if tables changed */
     }
 }
@@ -42173,7 +45335,7 @@ void query_order_by(
     sort_tables(world, query);  
 
     if (!query->table_slices) {
-        build_sorted_tables(query);
+        build_sorted_tables(query, true);
     }
 error:
     return;
@@ -42310,11 +45472,16 @@ ecs_query_t* ecs_query_init(
         result->group_by_ctx = &result->filter.terms[cascade_by - 1];
     }
 
-    if (desc->group_by) {
+    if (desc->group_by || desc->group_by_id) {
         /* Can't have a cascade term and group by at the same time, as cascade
          * uses the group_by mechanism */
         ecs_check(!result->cascade_by, ECS_INVALID_PARAMETER, NULL);
-        query_group_by(result, desc->group_by_id, desc->group_by);
+        ecs_group_by_action_t group_by = desc->group_by;
+        if (!group_by) {
+            group_by = group_by_relation;
+        }
+
+        query_group_by(result, desc->group_by_id, group_by);
         result->group_by_ctx = desc->group_by_ctx;
         result->group_by_ctx_free = desc->group_by_ctx_free;
     }
@@ -42551,13 +45718,12 @@ noresults:
 static
 int find_smallest_column(
     ecs_table_t *table,
-    ecs_query_table_match_t *table_data,
     ecs_vector_t *sparse_columns)
 {
     flecs_switch_term_t *sparse_column_array = 
         ecs_vector_first(sparse_columns, flecs_switch_term_t);
     int32_t i, count = ecs_vector_count(sparse_columns);
-    int32_t min = INT_MAX, index = 0;
+    int32_t min = INT_MAX, index = 1;
 
     for (i = 0; i < count; i ++) {
         /* The array with sparse queries for the matched table */
@@ -42568,18 +45734,20 @@ int find_smallest_column(
 
         /* If the sparse column pointer hadn't been retrieved yet, do it now */
         if (!sw) {
-            /* Get the table column index from the signature column index */
-            int32_t table_column_index = table_data->columns[
-                sparse_column->signature_column_index];
-
-            /* Translate the table column index to switch column index */
-            table_column_index -= table->sw_offset;
-            ecs_assert(table_column_index >= 1, ECS_INTERNAL_ERROR, NULL);
+            ecs_assert(sparse_column->sw_index >= 0, 
+                ECS_INTERNAL_ERROR, NULL);
+            ecs_assert(sparse_column->sw_index < table->sw_count, 
+                ECS_INTERNAL_ERROR, NULL);
 
             /* Get the sparse column */
             ecs_data_t *data = &table->data;
             sw = sparse_column->sw_column = 
-                &data->sw_columns[table_column_index - 1];
+                &data->sw_columns[sparse_column->sw_index];
+        }
+
+        /* Negated columns can't be iterated with the case list */
+        if (sparse_column->sw_not) {
+            continue;
         }
 
         /* Find the smallest column */
@@ -42598,10 +45766,18 @@ typedef struct {
     int32_t count;
 } query_iter_cursor_t;
 
+static
+bool sparse_column_match(
+    const flecs_switch_term_t *column,
+    int32_t row)
+{
+    bool has_case = flecs_switch_get(column->sw_column, row) == column->sw_case;
+    return has_case != column->sw_not;
+}
+
 static
 int sparse_column_next(
     ecs_table_t *table,
-    ecs_query_table_match_t *matched_table,
     ecs_vector_t *sparse_columns,
     ecs_query_iter_t *iter,
     query_iter_cursor_t *cur,
@@ -42612,7 +45788,7 @@ int sparse_column_next(
 
     if (!(sparse_smallest = iter->sparse_smallest)) {
         sparse_smallest = iter->sparse_smallest = find_smallest_column(
-            table, matched_table, sparse_columns);
+            table, sparse_columns);
         first_iteration = true;
     }
 
@@ -42621,55 +45797,53 @@ int sparse_column_next(
     flecs_switch_term_t *columns = ecs_vector_first(
         sparse_columns, flecs_switch_term_t);
     flecs_switch_term_t *column = &columns[sparse_smallest];
-    ecs_switch_t *sw, *sw_smallest = column->sw_column;
+    ecs_switch_t *sw_smallest = column->sw_column;
     ecs_entity_t case_smallest = column->sw_case;
 
+    /* If the smallest column is negated all columns are, and the case lists
+     * can't be used to find entities. Scan the rows in the range instead. */
+    bool scan = filter || column->sw_not;
+    int32_t first, end = cur->first + cur->count;
+
     /* Find next entity to iterate in sparse column */
-    int32_t first, sparse_first = iter->sparse_first;
+    if (filter) {
+        first = cur->first;
+    } else if (scan) {
+        first = first_iteration ? cur->first : (iter->sparse_first + 1);
+    } else if (first_iteration) {
+        first = flecs_switch_first(sw_smallest, case_smallest);
+    } else {
+        first = flecs_switch_next(sw_smallest, iter->sparse_first);
+    }
 
-    if (!filter) {
-        if (first_iteration) {
-            first = flecs_switch_first(sw_smallest, case_smallest);
-        } else {
-            first = flecs_switch_next(sw_smallest, sparse_first);
+    /* Check if entity matches with all sparse columns */
+    int32_t i, count = ecs_vector_count(sparse_columns);
+    while (first != -1) {
+        if (scan && first >= end) {
+            goto done;
         }
-    } else {
-        int32_t cur_first = cur->first, cur_count = cur->count;
-        first = cur_first;
-        while (flecs_switch_get(sw_smallest, first) != case_smallest) {
-            first ++;
-            if (first >= (cur_first + cur_count)) {
-                first = -1;
+
+        for (i = 0; i < count; i ++) {
+            if (!sparse_column_match(&columns[i], first)) {
                 break;
             }
         }
+
+        if (i == count) {
+            break;
+        }
+
+        if (scan) {
+            first ++;
+        } else {
+            first = flecs_switch_next(sw_smallest, first);
+        }
     }
 
     if (first == -1) {
         goto done;
     }
 
-    /* Check if entity matches with other sparse columns, if any */
-    int32_t i, count = ecs_vector_count(sparse_columns);
-    do {
-        for (i = 0; i < count; i ++) {
-            if (i == sparse_smallest) {
-                /* Already validated this one */
-                continue;
-            }
-
-            column = &columns[i];
-            sw = column->sw_column;
-
-            if (flecs_switch_get(sw, first) != column->sw_case) {
-                first = flecs_switch_next(sw_smallest, first);
-                if (first == -1) {
-                    goto done;
-                }
-            }
-        }
-    } while (i != count);
-
     cur->first = iter->sparse_first = first;
     cur->count = 1;
 
@@ -42685,6 +45859,33 @@ done:
 
 #define BS_MAX ((uint64_t)0xFFFFFFFFFFFFFFFF)
 
+#if defined(_MSC_VER) && defined(_WIN64) && !defined(__clang__)
+#include <intrin.h>
+#pragma intrinsic(_BitScanForward64)
+#endif
+
+/* Index of the lowest set bit in a non-zero 64bit word */
+static
+int32_t flecs_ctz64(
+    uint64_t v)
+{
+    ecs_assert(v != 0, ECS_INTERNAL_ERROR, NULL);
+#if defined(__GNUC__) || defined(__clang__)
+    return (int32_t)__builtin_ctzll(v);
+#elif defined(_MSC_VER) && defined(_WIN64)
+    unsigned long index;
+    _BitScanForward64(&index, v);
+    return (int32_t)index;
+#else
+    int32_t index = 0;
+    while (!(v & 1)) {
+        v >>= 1;
+        index ++;
+    }
+    return index;
+#endif
+}
+
 static
 int bitset_column_next(
     ecs_table_t *table,
@@ -42692,52 +45893,6 @@ int bitset_column_next(
     ecs_query_iter_t *iter,
     query_iter_cursor_t *cur)
 {
-    /* Precomputed single-bit test */
-    static const uint64_t bitmask[64] = {
-    (uint64_t)1 << 0, (uint64_t)1 << 1, (uint64_t)1 << 2, (uint64_t)1 << 3,
-    (uint64_t)1 << 4, (uint64_t)1 << 5, (uint64_t)1 << 6, (uint64_t)1 << 7,
-    (uint64_t)1 << 8, (uint64_t)1 << 9, (uint64_t)1 << 10, (uint64_t)1 << 11,
-    (uint64_t)1 << 12, (uint64_t)1 << 13, (uint64_t)1 << 14, (uint64_t)1 << 15,
-    (uint64_t)1 << 16, (uint64_t)1 << 17, (uint64_t)1 << 18, (uint64_t)1 << 19,
-    (uint64_t)1 << 20, (uint64_t)1 << 21, (uint64_t)1 << 22, (uint64_t)1 << 23,
-    (uint64_t)1 << 24, (uint64_t)1 << 25, (uint64_t)1 << 26, (uint64_t)1 << 27,  
-    (uint64_t)1 << 28, (uint64_t)1 << 29, (uint64_t)1 << 30, (uint64_t)1 << 31,
-    (uint64_t)1 << 32, (uint64_t)1 << 33, (uint64_t)1 << 34, (uint64_t)1 << 35,  
-    (uint64_t)1 << 36, (uint64_t)1 << 37, (uint64_t)1 << 38, (uint64_t)1 << 39,
-    (uint64_t)1 << 40, (uint64_t)1 << 41, (uint64_t)1 << 42, (uint64_t)1 << 43,
-    (uint64_t)1 << 44, (uint64_t)1 << 45, (uint64_t)1 << 46, (uint64_t)1 << 47,  
-    (uint64_t)1 << 48, (uint64_t)1 << 49, (uint64_t)1 << 50, (uint64_t)1 << 51,
-    (uint64_t)1 << 52, (uint64_t)1 << 53, (uint64_t)1 << 54, (uint64_t)1 << 55,  
-    (uint64_t)1 << 56, (uint64_t)1 << 57, (uint64_t)1 << 58, (uint64_t)1 << 59,
-    (uint64_t)1 << 60, (uint64_t)1 << 61, (uint64_t)1 << 62, (uint64_t)1 << 63
-    };
-
-    /* Precomputed test to verify if remainder of block is set (or not) */
-    static const uint64_t bitmask_remain[64] = {
-    BS_MAX, BS_MAX - (BS_MAX >> 63), BS_MAX - (BS_MAX >> 62),
-    BS_MAX - (BS_MAX >> 61), BS_MAX - (BS_MAX >> 60), BS_MAX - (BS_MAX >> 59),
-    BS_MAX - (BS_MAX >> 58), BS_MAX - (BS_MAX >> 57), BS_MAX - (BS_MAX >> 56), 
-    BS_MAX - (BS_MAX >> 55), BS_MAX - (BS_MAX >> 54), BS_MAX - (BS_MAX >> 53), 
-    BS_MAX - (BS_MAX >> 52), BS_MAX - (BS_MAX >> 51), BS_MAX - (BS_MAX >> 50), 
-    BS_MAX - (BS_MAX >> 49), BS_MAX - (BS_MAX >> 48), BS_MAX - (BS_MAX >> 47), 
-    BS_MAX - (BS_MAX >> 46), BS_MAX - (BS_MAX >> 45), BS_MAX - (BS_MAX >> 44), 
-    BS_MAX - (BS_MAX >> 43), BS_MAX - (BS_MAX >> 42), BS_MAX - (BS_MAX >> 41), 
-    BS_MAX - (BS_MAX >> 40), BS_MAX - (BS_MAX >> 39), BS_MAX - (BS_MAX >> 38), 
-    BS_MAX - (BS_MAX >> 37), BS_MAX - (BS_MAX >> 36), BS_MAX - (BS_MAX >> 35), 
-    BS_MAX - (BS_MAX >> 34), BS_MAX - (BS_MAX >> 33), BS_MAX - (BS_MAX >> 32), 
-    BS_MAX - (BS_MAX >> 31), BS_MAX - (BS_MAX >> 30), BS_MAX - (BS_MAX >> 29), 
-    BS_MAX - (BS_MAX >> 28), BS_MAX - (BS_MAX >> 27), BS_MAX - (BS_MAX >> 26), 
-    BS_MAX - (BS_MAX >> 25), BS_MAX - (BS_MAX >> 24), BS_MAX - (BS_MAX >> 23), 
-    BS_MAX - (BS_MAX >> 22), BS_MAX - (BS_MAX >> 21), BS_MAX - (BS_MAX >> 20), 
-    BS_MAX - (BS_MAX >> 19), BS_MAX - (BS_MAX >> 18), BS_MAX - (BS_MAX >> 17), 
-    BS_MAX - (BS_MAX >> 16), BS_MAX - (BS_MAX >> 15), BS_MAX - (BS_MAX >> 14), 
-    BS_MAX - (BS_MAX >> 13), BS_MAX - (BS_MAX >> 12), BS_MAX - (BS_MAX >> 11), 
-    BS_MAX - (BS_MAX >> 10), BS_MAX - (BS_MAX >> 9), BS_MAX - (BS_MAX >> 8), 
-    BS_MAX - (BS_MAX >> 7), BS_MAX - (BS_MAX >> 6), BS_MAX - (BS_MAX >> 5), 
-    BS_MAX - (BS_MAX >> 4), BS_MAX - (BS_MAX >> 3), BS_MAX - (BS_MAX >> 2),
-    BS_MAX - (BS_MAX >> 1)
-    };
-
     int32_t i, count = ecs_vector_count(bitset_columns);
     flecs_bitset_term_t *columns = ecs_vector_first(
         bitset_columns, flecs_bitset_term_t);
@@ -42769,53 +45924,38 @@ int bitset_column_next(
         int32_t bs_start = first & 0x3F;
 
         /* Step 1: find the first non-empty block */
-        uint64_t v = data[bs_block];
-        uint64_t remain = bitmask_remain[bs_start];
-        while (!(v & remain)) {
+        uint64_t v = data[bs_block] & (BS_MAX << bs_start);
+        while (!v) {
             /* If no elements are remaining, move to next block */
             if ((++bs_block) >= bs_block_count) {
                 /* No non-empty blocks left */
                 goto done;
             }
 
-            bs_start = 0;
-            remain = BS_MAX; /* Test the full block */
             v = data[bs_block];
         }
 
-        /* Step 2: find the first non-empty element in the block */
-        while (!(v & bitmask[bs_start])) {
-            bs_start ++;
-
-            /* Block was not empty, so bs_start must be smaller than 64 */
-            ecs_assert(bs_start < 64, ECS_INTERNAL_ERROR, NULL);
-        }
-        
-        /* Step 3: Find number of contiguous enabled elements after start */
-        int32_t bs_end = bs_start, bs_block_end = bs_block;
+        /* Step 2: find the first enabled element in the block */
+        bs_start = flecs_ctz64(v);
         
-        remain = bitmask_remain[bs_end];
-        while ((v & remain) == remain) {
-            bs_end = 0;
+        /* Step 3: find the first block with a disabled element after start */
+        int32_t bs_end = 0, bs_block_end = bs_block;
+        uint64_t off = ~v & (BS_MAX << bs_start);
+        while (!off) {
             bs_block_end ++;
 
             if (bs_block_end == bs_block_count) {
                 break;
             }
 
-            v = data[bs_block_end];
-            remain = BS_MAX; /* Test the full block */
+            off = ~data[bs_block_end];
         }
 
-        /* Step 4: find remainder of enabled elements in current block */
+        /* Step 4: find the first disabled element in that block */
         if (bs_block_end != bs_block_count) {
-            while ((v & bitmask[bs_end])) {
-                bs_end ++;
-            }
+            bs_end = flecs_ctz64(off);
         }
 
-        /* Block was not 100% occupied, so bs_start must be smaller than 64 */
-        ecs_assert(bs_end < 64, ECS_INTERNAL_ERROR, NULL);
 
         /* Step 5: translate to element start/end and make sure that each column
          * range is a subset of the previous one. */
@@ -42851,7 +45991,7 @@ int bitset_column_next(
          * the table */
         if (elem_count > (bs_elem_count - first)) {
             elem_count = (bs_elem_count - first);
-            if (!elem_count) {
+            if (elem_count <= 0) {
                 iter->bitset_first = 0;
                 goto done;
             }
@@ -42907,6 +46047,7 @@ void mark_columns_dirty(
                 table, index - 1);
             if (storage_index >= 0) {
                 table->dirty_state[storage_index + 1] ++;
+                table->dirty_frame = query->world->info.frame_count_total;
             }
         }
     }
@@ -42951,12 +46092,19 @@ bool ecs_query_next_instanced(
 
     query_iter_cursor_t cur;
     ecs_query_table_node_t *node, *next, *prev;
+    bool skip_unchanged = flags & EcsQuerySkipUnchanged;
     if ((prev = iter->prev)) {
-        /* Match has been iterated, update monitor for change tracking */
+        /* Match has been iterated, update monitor for change tracking. When
+         * skipping unchanged tables, columns are marked dirty before syncing
+         * the monitor so writes of the iterator itself aren't seen as changes
+         * by the next iteration. */
+        if ((flags & EcsQueryHasOutColumns) && skip_unchanged) {
+            mark_columns_dirty(query, prev->match);
+        }
         if (flags & EcsQueryHasMonitor) {
             sync_match_monitor(query, prev->match);
         }
-        if (flags & EcsQueryHasOutColumns) {
+        if ((flags & EcsQueryHasOutColumns) && !skip_unchanged) {
             mark_columns_dirty(query, prev->match);
         }
     }
@@ -42969,7 +46117,20 @@ bool ecs_query_next_instanced(
         ecs_query_table_match_t *match = node->match;
         ecs_table_t *table = match->table;
 
-        next = node->next;
+        /* Stop at the last node if iteration is limited to a group */
+        ecs_query_table_node_t *node_next = NULL;
+        if (node != iter->last) {
+            node_next = node->next;
+        }
+
+        next = node_next;
+
+        /* Don't skip the remainder of a table that is partially iterated */
+        if (skip_unchanged && table && node != prev) {
+            if (!check_match_monitor(query, match)) {
+                continue;
+            }
+        }
 
         if (table) {
             cur.first = node->offset;
@@ -43004,13 +46165,13 @@ bool ecs_query_next_instanced(
                     }
 
                     if (sparse_columns) {
-                        if (sparse_column_next(table, match,
-                            sparse_columns, iter, &cur, found) == -1)
+                        if (sparse_column_next(table, sparse_columns, 
+                            iter, &cur, found) == -1)
                         {
                             /* No more elements in sparse column */
                             if (found) {
                                 /* Try again */
-                                next = node->next;
+                                next = node_next;
                                 found = false;
                             } else {
                                 /* Nothing found */
@@ -43057,6 +46218,7 @@ bool ecs_query_next_instanced(
 
         it->subjects = match->subjects;
         it->references = match->references;
+        it->group_id = match->group_id;
         it->instance_count = 0;
 
         flecs_iter_populate_data(world, it, match->table, cur.first, cur.count, 
@@ -43143,6 +46305,39 @@ void ecs_query_skip(
     }
 }
 
+void ecs_query_set_group(
+    ecs_iter_t *it,
+    uint64_t group_id)
+{
+    ecs_check(it != NULL, ECS_INVALID_PARAMETER, NULL);
+    ecs_check(it->next == ecs_query_next, ECS_INVALID_PARAMETER, NULL);
+    ecs_check(!ECS_BIT_IS_SET(it->flags, EcsIterIsValid), 
+        ECS_INVALID_PARAMETER, NULL);
+
+    if (ECS_BIT_IS_SET(it->flags, EcsIterNoResults)) {
+        return;
+    }
+
+    ecs_query_iter_t *iter = &it->priv.iter.query;
+    ecs_query_t *query = iter->query;
+    ecs_check(query != NULL, ECS_INVALID_PARAMETER, NULL);
+    ecs_check(query->group_by != NULL, ECS_INVALID_PARAMETER, NULL);
+    ecs_check(query->order_by == NULL, ECS_INVALID_PARAMETER, NULL);
+
+    ecs_query_table_list_t *list = get_group(query, group_id);
+    if (!list) {
+        /* Group doesn't exist or has no non-empty tables */
+        ECS_BIT_SET(it->flags, EcsIterNoResults);
+        return;
+    }
+
+    iter->node = list->first;
+    iter->last = list->last;
+    it->table_count = list->count;
+error:
+    return;
+}
+
 bool ecs_query_orphaned(
     ecs_query_t *query)
 {
@@ -43411,6 +46606,21 @@ void flecs_type_add(
     }
 }
 
+/* Remove from type */
+static
+void flecs_type_remove(
+    ecs_type_t *type,
+    ecs_id_t remove)
+{
+    ecs_type_t new_type;
+    int res = flecs_type_new_without(&new_type, type, remove);
+    if (res != -1) {
+        flecs_type_free(type);
+        type->array = new_type.array;
+        type->count = new_type.count;
+    }
+}
+
 /* Graph edge utilities */
 
 static
@@ -43959,6 +47169,18 @@ void compute_table_diff(
 
     ecs_assert(diff->added.count == added_count, ECS_INTERNAL_ERROR, NULL);
     ecs_assert(diff->removed.count == removed_count, ECS_INTERNAL_ERROR, NULL);
+
+    /* If the edge adds a union column, report the union case that is added
+     * instead, so it can be stored in the union column. */
+    if (ECS_HAS_ROLE(id, PAIR) && (next->flags & EcsTableHasUnion)) {
+        ecs_id_t union_id = ecs_pair(EcsUnion, ECS_PAIR_FIRST(id));
+        int32_t i;
+        for (i = 0; i < diff->added.count; i ++) {
+            if (diff->added.array[i] == union_id) {
+                diff->added.array[i] = id;
+            }
+        }
+    }
 }
 
 static
@@ -44095,6 +47317,12 @@ ecs_table_t* flecs_find_table_with(
         flecs_add_with_property(world, idr_with_wildcard, &dst_type, r, o);
     }
 
+    if ((idr->flags & EcsIdToggle) && !ECS_HAS_ROLE(with, PAIR)) {
+        /* Toggleable components always have a bitset column, so that enabling
+         * or disabling the component doesn't move the entity */
+        flecs_type_add(&dst_type, ECS_DISABLED | with);
+    }
+
     return find_or_create(world, &dst_type, true, node);
 }
 
@@ -44121,6 +47349,14 @@ ecs_table_t* flecs_find_table_without(
         return node; /* Current table does not have id */
     }
 
+    if (!ECS_HAS_ROLE(without, PAIR) && !ecs_id_is_wildcard(without)) {
+        /* Remove bitset column of toggleable component with the component */
+        ecs_id_record_t *idr = flecs_get_id_record(world, without);
+        if (idr && idr->flags & EcsIdToggle) {
+            flecs_type_remove(&dst_type, ECS_DISABLED | without);
+        }
+    }
+
     return find_or_create(world, &dst_type, true, node);
 }
 
@@ -44903,6 +48139,29 @@ error:
     return false;
 }
 
+bool ecs_term_is_aligned(
+    const ecs_iter_t *it,
+    int32_t term_index)
+{
+    ecs_check(it->flags & EcsIterIsValid, ECS_INVALID_PARAMETER, NULL);
+    ecs_check(term_index > 0, ECS_INVALID_PARAMETER, NULL);
+
+#ifdef FLECS_COLUMN_ALIGNMENT
+    /* Only owned terms point into a table column */
+    if (!it->ptrs || (it->subjects && it->subjects[term_index - 1])) {
+        return false;
+    }
+
+    uintptr_t ptr = (uintptr_t)it->ptrs[term_index - 1];
+    return ptr && !(ptr & (FLECS_COLUMN_ALIGNMENT - 1));
+#else
+    (void)it;
+    (void)term_index;
+#endif
+error:
+    return false;
+}
+
 int32_t ecs_iter_find_column(
     const ecs_iter_t *it,
     ecs_entity_t component)
@@ -45556,6 +48815,96 @@ error:
     return false;
 }
 
+ecs_iter_t ecs_changed_iter(
+    const ecs_iter_t *it,
+    int32_t frame)
+{
+    ecs_check(it != NULL, ECS_INVALID_PARAMETER, NULL);
+    ecs_check(it->next != NULL, ECS_INVALID_PARAMETER, NULL);
+    ecs_check(frame >= 0, ECS_INVALID_PARAMETER, NULL);
+
+    ecs_iter_t result = *it;
+    result.priv.iter.changed = (ecs_changed_iter_t){
+        .frame = frame
+    };
+    result.next = ecs_changed_next;
+    result.chain_it = (ecs_iter_t*)it;
+
+    return result;
+error:
+    return (ecs_iter_t){ 0 };
+}
+
+static
+bool table_changed_since(
+    ecs_table_t *table,
+    int32_t frame)
+{
+    if (!table) {
+        return true; /* Task query */
+    }
+
+    if (!table->dirty_state) {
+        /* Table isn't tracking changes yet. Start tracking so that the next
+         * iteration can filter it, and treat it as changed for now. */
+        flecs_table_get_dirty_state(table);
+        return true;
+    }
+
+    return table->dirty_frame >= frame;
+}
+
+static
+bool ecs_changed_next_instanced(
+    ecs_iter_t *it)
+{
+    ecs_check(it != NULL, ECS_INVALID_PARAMETER, NULL);
+    ecs_check(it->chain_it != NULL, ECS_INVALID_PARAMETER, NULL);
+    ecs_check(it->next == ecs_changed_next, ECS_INVALID_PARAMETER, NULL);
+
+    ecs_iter_t *chain_it = it->chain_it;
+    int32_t frame = it->priv.iter.changed.frame;
+    bool instanced = ECS_BIT_IS_SET(it->flags, EcsIterIsInstanced);
+
+    do {
+        if (!ecs_iter_next(chain_it)) {
+            return false;
+        }
+    } while (!table_changed_since(chain_it->table, frame));
+
+    /* Copy everything up to the private iterator data */
+    ecs_os_memcpy(it, chain_it, offsetof(ecs_iter_t, priv));
+
+    /* Keep instancing setting from original iterator */
+    ECS_BIT_COND(it->flags, EcsIterIsInstanced, instanced);
+
+    if (!instanced) {
+        it->offset = 0;
+    }
+
+    return true;
+error:
+    return false;
+}
+
+bool ecs_changed_next(
+    ecs_iter_t *it)
+{
+    ecs_check(it != NULL, ECS_INVALID_PARAMETER, NULL);
+    ecs_check(it->next == ecs_changed_next, ECS_INVALID_PARAMETER, NULL);
+    ecs_check(it->chain_it != NULL, ECS_INVALID_PARAMETER, NULL);
+
+    ECS_BIT_SET(it->chain_it->flags, EcsIterIsInstanced);
+
+    if (flecs_iter_next_row(it)) {
+        return true;
+    }
+
+    return flecs_iter_next_instanced(it, ecs_changed_next_instanced(it));
+error:
+    return false;
+}
+
 #include <stddef.h>
 
 static
@@ -45615,22 +48964,139 @@ ecs_event_id_record_t* ensure_event_id_record(
 }
 
 static
-ecs_flags32_t id_flag_for_event(
-    ecs_entity_t e)
+bool event_record_observes_id(
+    const ecs_event_record_t *evt,
+    ecs_id_t id)
 {
-    if (e == EcsOnAdd) {
-        return EcsIdHasOnAdd;
+    if (!evt || !ecs_map_count(&evt->event_ids)) {
+        return false;
     }
-    if (e == EcsOnRemove) {
-        return EcsIdHasOnRemove;
+
+    const ecs_map_t *ids = &evt->event_ids;
+    ecs_event_id_record_t *idt = ecs_map_get_ptr(
+        ids, ecs_event_id_record_t*, id);
+    if (idt && idt->trigger_count) {
+        return true;
     }
-    if (e == EcsOnSet) {
-        return EcsIdHasOnSet;
+
+    if (evt->wildcard_count) {
+        return true;
     }
-    if (e == EcsUnSet) {
-        return EcsIdHasUnSet;
+
+    if (ECS_HAS_ROLE(id, PAIR)) {
+        if (evt->rel_wildcard_count) {
+            idt = ecs_map_get_ptr(ids, ecs_event_id_record_t*, 
+                ecs_pair(ECS_PAIR_FIRST(id), EcsWildcard));
+            if (idt && idt->trigger_count) {
+                return true;
+            }
+        }
+
+        /* (*, O) and (*, *) are counted together, which can cause false 
+         * positives but never false negatives. */
+        if (evt->obj_wildcard_count) {
+            return true;
+        }
     }
-    return 0;
+
+    return false;
+}
+
+ecs_flags32_t flecs_id_observed_flags(
+    const ecs_world_t *world,
+    ecs_id_t id)
+{
+    const ecs_observable_t *observable = &world->observable;
+    ecs_sparse_t *events = observable->events;
+    ecs_entity_t kinds[4] = {EcsOnAdd, EcsOnRemove, EcsOnSet, EcsUnSet};
+    ecs_flags32_t flags[4] = {
+        EcsIdHasOnAdd, EcsIdHasOnRemove, EcsIdHasOnSet, EcsIdHasUnSet};
+
+    /* Triggers for EcsWildcard are notified for all events */
+    if (event_record_observes_id(
+        flecs_sparse_get(events, ecs_event_record_t, EcsWildcard), id)) 
+    {
+        return EcsIdEventMask;
+    }
+
+    ecs_flags32_t result = 0;
+    int i;
+    for (i = 0; i < 4; i ++) {
+        if (event_record_observes_id(
+            flecs_sparse_get(events, ecs_event_record_t, kinds[i]), id)) 
+        {
+            result |= flags[i];
+        }
+    }
+
+    return result;
+}
+
+static
+void update_observed_flags_for_record(
+    ecs_world_t *world,
+    ecs_id_record_t *idr)
+{
+    idr->flags &= ~EcsIdEventMask;
+    idr->flags |= flecs_id_observed_flags(world, idr->id);
+}
+
+/* Update the observed flags of the id records that match an id for which
+ * triggers were added or removed */
+static
+void update_observed_flags(
+    ecs_world_t *world,
+    ecs_id_t id)
+{
+    ecs_id_record_t *idr, *cur;
+
+    if (world->is_fini) {
+        return;
+    }
+
+    if (!ecs_id_is_wildcard(id)) {
+        if ((idr = flecs_get_id_record(world, id))) {
+            update_observed_flags_for_record(world, idr);
+        }
+    } else if (ECS_HAS_ROLE(id, PAIR) && 
+        ECS_PAIR_FIRST(id) != EcsWildcard && ECS_PAIR_FIRST(id) != EcsAny &&
+        ECS_PAIR_SECOND(id) == EcsWildcard)
+    {
+        /* (R, *): the wildcard record links all (R, O) records */
+        if ((idr = flecs_get_id_record(world, id))) {
+            update_observed_flags_for_record(world, idr);
+            for (cur = idr->first.next; cur; cur = cur->first.next) {
+                update_observed_flags_for_record(world, cur);
+            }
+        }
+    } else {
+        /* Other wildcards are rare, update all records */
+        ecs_map_iter_t it = ecs_map_iter(&world->id_index);
+        while ((idr = ecs_map_next_ptr(&it, ecs_id_record_t*, NULL))) {
+            update_observed_flags_for_record(world, idr);
+        }
+    }
+}
+
+static
+int32_t* wildcard_count_for_id(
+    ecs_event_record_t *evt,
+    ecs_id_t id)
+{
+    if (id == EcsWildcard || id == EcsAny) {
+        return &evt->wildcard_count;
+    }
+
+    if (ECS_HAS_ROLE(id, PAIR)) {
+        if (ECS_PAIR_FIRST(id) == EcsWildcard) {
+            return &evt->obj_wildcard_count;
+        }
+        if (ECS_PAIR_SECOND(id) == EcsWildcard) {
+            return &evt->rel_wildcard_count;
+        }
+    }
+
+    return NULL;
 }
 
 static
@@ -45645,6 +49111,14 @@ void inc_trigger_count(
     ecs_assert(idt != NULL, ECS_INTERNAL_ERROR, NULL);
     
     int32_t result = idt->trigger_count += value;
+    if ((value > 0 && result == 1) || (value < 0 && result == 0)) {
+        int32_t *wc = wildcard_count_for_id(evt, id);
+        if (wc) {
+            wc[0] += value;
+            ecs_assert(wc[0] >= 0, ECS_INTERNAL_ERROR, NULL);
+        }
+    }
+
     if (result == 1) {
         /* Notify framework that there are triggers for the event/id. This 
          * allows parts of the code to skip event evaluation early */
@@ -45653,13 +49127,7 @@ void inc_trigger_count(
             .event = event
         });
 
-        ecs_flags32_t flags = id_flag_for_event(event);
-        if (flags) {
-            ecs_id_record_t *idr = flecs_get_id_record(world, id);
-            if (idr) {
-                idr->flags |= flags;
-            }
-        }
+        update_observed_flags(world, id);
     } else if (result == 0) {
         /* Ditto, but the reverse */
         flecs_notify_tables(world, id, &(ecs_table_event_t){
@@ -45667,13 +49135,7 @@ void inc_trigger_count(
             .event = event
         });
 
-        ecs_flags32_t flags = id_flag_for_event(event);
-        if (flags) {
-            ecs_id_record_t *idr = flecs_get_id_record(world, id);
-            if (idr) {
-                idr->flags &= ~flags;
-            }
-        }
+        update_observed_flags(world, id);
 
         /* Remove admin for id for event */
         if (!ecs_map_is_initialized(&idt->triggers) && 
@@ -45723,6 +49185,10 @@ void register_trigger_for_id(
 
         ecs_map_ensure(triggers, ecs_trigger_t*, trigger->id)[0] = trigger;
 
+        if (triggers_offset == offsetof(ecs_event_id_record_t, set_triggers)) {
+            evt->set_count ++;
+        }
+
         inc_trigger_count(world, event, evt, term_id, 1);
         if (term_id != id) {
             inc_trigger_count(world, event, evt, id, 1);
@@ -45789,6 +49255,11 @@ void unregister_trigger_for_id(
             ecs_map_fini(id_triggers);
         }
 
+        if (triggers_offset == offsetof(ecs_event_id_record_t, set_triggers)) {
+            evt->set_count --;
+            ecs_assert(evt->set_count >= 0, ECS_INTERNAL_ERROR, NULL);
+        }
+
         inc_trigger_count(world, event, evt, term_id, -1);
 
         if (id != term_id) {
@@ -45833,7 +49304,7 @@ void unregister_trigger(
 }
 
 static
-ecs_map_t* get_triggers_for_event(
+const ecs_event_record_t* get_event_record(
     const ecs_observable_t *observable,
     ecs_entity_t event)
 {
@@ -45845,12 +49316,26 @@ ecs_map_t* get_triggers_for_event(
 
     const ecs_event_record_t *evt = flecs_sparse_get(
         events, ecs_event_record_t, event);
-    
+
+    /* Records of events that no longer have triggers stick around */
+    if (evt && ecs_map_count(&evt->event_ids)) {
+        return evt;
+    }
+
+error:
+    return NULL;
+}
+
+static
+ecs_map_t* get_triggers_for_event(
+    const ecs_observable_t *observable,
+    ecs_entity_t event)
+{
+    const ecs_event_record_t *evt = get_event_record(observable, event);
     if (evt) {
         return (ecs_map_t*)&evt->event_ids;
     }
 
-error:
     return NULL;
 }
 
@@ -46232,17 +49717,56 @@ void notify_triggers_for_id(
 }
 
 static
-void notify_set_triggers_for_id(
+void notify_union_triggers(
+    ecs_world_t *world,
+    ecs_iter_t *it,
+    const ecs_map_t *triggers)
+{
+    ecs_assert(triggers != NULL, ECS_INTERNAL_ERROR, NULL);
+
+    ecs_map_iter_t mit = ecs_map_iter(triggers);
+    ecs_trigger_t *t;
+    while ((t = ecs_map_next_ptr(&mit, ecs_trigger_t*, NULL))) {
+        /* Triggers for all cases of a union are registered for the same
+         * (Union, Relation) id, so filter on the case that changed */
+        if (!ecs_id_match(it->event_id, t->term.id)) {
+            continue;
+        }
+
+        if (ignore_trigger(world, t, it->table)) {
+            continue;
+        }
+
+        ECS_BIT_COND(it->flags, EcsIterIsFilter, 
+            t->term.inout == EcsInOutFilter);
+
+        it->system = t->entity;
+        it->self = t->self;
+        it->ctx = t->ctx;
+        it->binding_ctx = t->binding_ctx;
+        it->term_index = t->term.index;
+        it->terms = &t->term;
+        t->callback(it);
+    }
+}
+
+static
+void notify_union_triggers_for_id(
     ecs_world_t *world,
     const ecs_map_t *evt,
+    ecs_entity_t rel,
     ecs_iter_t *it,
-    bool *iter_set,
-    ecs_id_t set_id)
+    bool *iter_set)
 {
-    const ecs_event_id_record_t *idt = get_triggers_for_id(evt, set_id);
-    if (idt && ecs_map_is_initialized(&idt->set_triggers)) {
+    const ecs_event_id_record_t *idt = get_triggers_for_id(
+        evt, ecs_pair(EcsUnion, rel));
+    if (!idt) {
+        return;
+    }
+
+    if (ecs_map_is_initialized(&idt->triggers)) {
         init_iter(it, iter_set);
-        notify_set_triggers(world, it, &idt->set_triggers);
+        notify_union_triggers(world, it, &idt->triggers);
     }
 }
 
@@ -46291,14 +49815,22 @@ void flecs_triggers_notify(
     int32_t e, i, ids_count = ids->count;
     ecs_id_t *ids_array = ids->array;
     ecs_world_t *world = it->real_world;
+    bool has_union = (it->table->flags & EcsTableHasUnion) != 0;
 
     for (e = 0; e < 2; e ++) {
         event = events[e];
-        const ecs_map_t *evt = get_triggers_for_event(observable, event);
-        if (!evt) {
+        const ecs_event_record_t *er = get_event_record(observable, event);
+        if (!er) {
             continue;
         }
 
+        /* Only do lookups for the kinds of wildcard ids that have triggers,
+         * as most events only have triggers for a few (R, *) pairs */
+        const ecs_map_t *evt = &er->event_ids;
+        bool has_wildcards = er->wildcard_count != 0;
+        bool has_rel_wildcards = er->rel_wildcard_count != 0;
+        bool has_obj_wildcards = er->obj_wildcard_count != 0;
+
         it->event = event;
 
         for (i = 0; i < ids_count; i ++) {
@@ -46312,21 +49844,33 @@ void flecs_triggers_notify(
 
             if (role == ECS_PAIR) {
                 ecs_entity_t r = ECS_PAIR_FIRST(id);
-                ecs_entity_t o = ECS_PAIR_SECOND(id);
 
-                ecs_id_t tid = ecs_pair(r, EcsWildcard);
-                notify_triggers_for_id(world, evt, tid, it, &iter_set);
+                if (has_rel_wildcards) {
+                    ecs_id_t tid = ecs_pair(r, EcsWildcard);
+                    notify_triggers_for_id(world, evt, tid, it, &iter_set);
+                }
 
-                tid = ecs_pair(EcsWildcard, o);
-                notify_triggers_for_id(world, evt, tid, it, &iter_set);
-                
-                tid = ecs_pair(EcsWildcard, EcsWildcard);
-                notify_triggers_for_id(world, evt, tid, it, &iter_set);
-            } else {
+                if (has_obj_wildcards) {
+                    ecs_entity_t o = ECS_PAIR_SECOND(id);
+                    ecs_id_t tid = ecs_pair(EcsWildcard, o);
+                    notify_triggers_for_id(world, evt, tid, it, &iter_set);
+                    
+                    tid = ecs_pair(EcsWildcard, EcsWildcard);
+                    notify_triggers_for_id(world, evt, tid, it, &iter_set);
+                }
+
+                /* Union cases don't change the table type, and triggers for
+                 * union relations are registered for (Union, Relation) */
+                if (has_union) {
+                    notify_union_triggers_for_id(world, evt, r, it, &iter_set);
+                }
+            } else if (has_wildcards) {
                 notify_triggers_for_id(world, evt, EcsWildcard, it, &iter_set);
             }
 
-            notify_triggers_for_id(world, evt, EcsAny, it, &iter_set);
+            if (has_wildcards) {
+                notify_triggers_for_id(world, evt, EcsAny, it, &iter_set);
+            }
 
             if (iter_set) {
                 ecs_iter_fini(it);
@@ -46335,6 +49879,19 @@ void flecs_triggers_notify(
     }
 }
 
+bool flecs_set_triggers_exist(
+    ecs_observable_t *observable,
+    ecs_entity_t event)
+{
+    const ecs_event_record_t *er = get_event_record(observable, event);
+    if (er && er->set_count) {
+        return true;
+    }
+
+    er = get_event_record(observable, EcsWildcard);
+    return er && er->set_count;
+}
+
 void flecs_set_triggers_notify(
     ecs_iter_t *it,
     ecs_observable_t *observable,
@@ -46349,22 +49906,34 @@ void flecs_set_triggers_notify(
     ecs_id_t *ids_array = ids->array;
     ecs_world_t *world = it->real_world;
 
+    if (ECS_BIT_IS_SET(it->flags, EcsIterTableOnly)) {
+        return;
+    }
+
     for (e = 0; e < 2; e ++) {
         event = events[e];
-        const ecs_map_t *evt = get_triggers_for_event(observable, event);
-        if (!evt) {
+        const ecs_event_record_t *er = get_event_record(observable, event);
+        if (!er || !er->set_count) {
+            continue;
+        }
+
+        /* The triggers only depend on the relation, so look them up once for
+         * all ids in the event */
+        const ecs_event_id_record_t *idt = get_triggers_for_id(
+            &er->event_ids, set_id);
+        if (!idt || !ecs_map_is_initialized(&idt->set_triggers)) {
             continue;
         }
 
         it->event = event;
 
         for (i = 0; i < ids_count; i ++) {
-            ecs_id_t id = ids_array[i];
             bool iter_set = false;
 
-            it->event_id = id;
+            it->event_id = ids_array[i];
 
-            notify_set_triggers_for_id(world, evt, it, &iter_set, set_id);
+            init_iter(it, &iter_set);
+            notify_set_triggers(world, it, &idt->set_triggers);
 
             if (iter_set) {
                 ecs_iter_fini(it);
@@ -46801,6 +50370,11 @@ void ecs_on_set(EcsIdentifier)(ecs_iter_t *it) {
             if (hash != index_hash) {
                 if (index_hash) {
                     flecs_name_index_remove(name_index, e, index_hash);
+
+                    /* Entity was renamed or lost its name */
+                    if (kind == EcsName) {
+                        flecs_path_cache_clear(world);
+                    }
                 }
                 if (hash) {
                     flecs_name_index_ensure(name_index, e, name, len, hash);
@@ -47021,6 +50595,11 @@ void register_union(ecs_iter_t *it) {
     register_id_flag_for_relation(it, EcsUnion, EcsIdUnion, 0, 0);
 }
 
+static
+void register_toggle(ecs_iter_t *it) {
+    register_id_flag_for_relation(it, EcsToggle, EcsIdToggle, 0, 0);
+}
+
 static
 void on_symmetric_add_remove(ecs_iter_t *it) {
     ecs_entity_t pair = ecs_term_id(it, 1);
@@ -47172,6 +50751,7 @@ void on_parent_change(ecs_iter_t *it) {
         uint64_t index_hash = name->index_hash;
         if (from_index && index_hash) {
             flecs_name_index_remove(from_index, e, index_hash);
+            flecs_path_cache_clear(it->real_world);
         }
         const char *name_str = name->value;
         if (to_index && name_str) {
@@ -47461,6 +51041,7 @@ void flecs_bootstrap(
     flecs_bootstrap_tag(world, EcsAcyclic);
     flecs_bootstrap_tag(world, EcsWith);
     flecs_bootstrap_tag(world, EcsOneOf);
+    flecs_bootstrap_tag(world, EcsToggle);
 
     flecs_bootstrap_tag(world, EcsOnDelete);
     flecs_bootstrap_tag(world, EcsOnDeleteObject);
@@ -47569,6 +51150,12 @@ void flecs_bootstrap(
         .callback = register_union
     });
 
+    ecs_trigger_init(world, &(ecs_trigger_desc_t){
+        .term = {.id = EcsToggle, .subj.set.mask = EcsSelf },
+        .events = {EcsOnAdd},
+        .callback = register_toggle
+    });
+
     /* Define trigger to make sure that adding a module to a child entity also
      * adds it to the parent. */
     ecs_trigger_init(world, &(ecs_trigger_desc_t){
@@ -47624,8 +51211,7 @@ bool path_append(
     ecs_poly_assert(world, ecs_world_t);
 
     ecs_entity_t cur = 0;
-    char buff[22];
-    const char *name;
+    const char *name = NULL;
 
     if (ecs_is_valid(world, child)) {
         cur = ecs_get_object(world, child, EcsChildOf, 0);
@@ -47640,16 +51226,13 @@ bool path_append(
         }
 
         name = ecs_get_name(world, child);
-        if (!name || !ecs_os_strlen(name)) {
-            ecs_os_sprintf(buff, "%u", (uint32_t)child);
-            name = buff;
-        }        
-    } else {
-        ecs_os_sprintf(buff, "%u", (uint32_t)child);
-        name = buff;
     }
 
-    ecs_strbuf_appendstr(buf, name);
+    if (name && name[0]) {
+        ecs_strbuf_appendstr(buf, name);
+    } else {
+        ecs_strbuf_appenduint(buf, (uint32_t)child);
+    }
 
     return cur != 0;
 }
@@ -47812,6 +51395,151 @@ void flecs_bootstrap_hierarchy(ecs_world_t *world) {
     });
 }
 
+/* -- Path cache -- */
+
+/* Upper bound for number of cached paths. When the cache is full, it is cleared
+ * so that lookups of many distinct paths don't grow memory without limit. */
+#define FLECS_PATH_CACHE_MAX (4096)
+
+typedef struct ecs_path_key_t {
+    const char *path;
+    const char *sep;
+    ecs_size_t path_length;
+    ecs_size_t sep_length;
+    ecs_entity_t parent;
+    uint64_t hash;
+} ecs_path_key_t;
+
+static
+uint64_t path_key_hash(
+    const void *ptr)
+{
+    const ecs_path_key_t *key = ptr;
+    return key->hash;
+}
+
+static
+int path_key_compare(
+    const void *ptr1, 
+    const void *ptr2)
+{
+    const ecs_path_key_t *key1 = ptr1;
+    const ecs_path_key_t *key2 = ptr2;
+
+    if (key1->parent != key2->parent) {
+        return (key1->parent > key2->parent) - (key1->parent < key2->parent);
+    }
+    if (key1->path_length != key2->path_length) {
+        return key1->path_length - key2->path_length;
+    }
+    if (key1->sep_length != key2->sep_length) {
+        return key1->sep_length - key2->sep_length;
+    }
+
+    int result = ecs_os_memcmp(key1->path, key2->path, key1->path_length);
+    if (result) {
+        return result;
+    }
+
+    return ecs_os_memcmp(key1->sep, key2->sep, key1->sep_length);
+}
+
+/* Only the path is hashed. Keys with the same path but a different separator
+ * end up in the same bucket, and are told apart by path_key_compare. */
+static
+ecs_path_key_t path_key(
+    const char *path,
+    ecs_size_t path_length,
+    uint64_t path_hash,
+    const char *sep)
+{
+    return (ecs_path_key_t) {
+        .path = path,
+        .sep = sep,
+        .path_length = path_length,
+        .sep_length = ecs_os_strlen(sep),
+        .hash = path_hash
+    };
+}
+
+/* Set parent of key. The path hash is reused when a recursive lookup retries
+ * the same path from a different parent. */
+static
+void path_key_set_parent(
+    ecs_path_key_t *key,
+    uint64_t path_hash,
+    ecs_entity_t parent)
+{
+    key->parent = parent;
+    key->hash = path_hash ^ (parent * 0x9E3779B97F4A7C15);
+}
+
+/* Returns whether lookups on the stage may modify the path cache, which is
+ * only safe if no other threads can be accessing the world. */
+static
+bool path_cache_writable(
+    const ecs_world_t *stage)
+{
+    const ecs_stage_t *s = flecs_stage_from_readonly_world(stage);
+    if (s->asynchronous) {
+        return false;
+    }
+
+    const ecs_world_t *world = ecs_get_world(stage);
+    return !(ecs_os_has_threading() && ecs_get_stage_count(world) > 1);
+}
+
+static
+void path_cache_insert(
+    ecs_world_t *world,
+    const ecs_path_key_t *key,
+    ecs_entity_t e)
+{
+    if (world->path_cache_count >= FLECS_PATH_CACHE_MAX) {
+        flecs_path_cache_clear(world);
+    }
+
+    /* Store path and separator in a single allocation owned by the cache */
+    char *str = ecs_os_malloc(key->path_length + key->sep_length + 2);
+    ecs_os_memcpy(str, key->path, key->path_length + 1);
+    ecs_os_memcpy(&str[key->path_length + 1], key->sep, key->sep_length + 1);
+
+    ecs_path_key_t cached = *key;
+    cached.path = str;
+    cached.sep = &str[key->path_length + 1];
+    flecs_hashmap_set(&world->path_cache, &cached, &e);
+    world->path_cache_count ++;
+}
+
+void flecs_path_cache_init(
+    ecs_world_t *world)
+{
+    flecs_hashmap_init(&world->path_cache, ecs_path_key_t, ecs_entity_t,
+        path_key_hash, path_key_compare);
+    world->path_cache_count = 0;
+}
+
+void flecs_path_cache_fini(
+    ecs_world_t *world)
+{
+    flecs_hashmap_iter_t it = flecs_hashmap_iter(&world->path_cache);
+    ecs_path_key_t *key;
+    while (flecs_hashmap_next_w_key(&it, ecs_path_key_t, &key, ecs_entity_t)) {
+        ecs_os_free((char*)key->path);
+    }
+
+    flecs_hashmap_fini(&world->path_cache);
+}
+
+void flecs_path_cache_clear(
+    ecs_world_t *world)
+{
+    if (world->path_cache_count) {
+        flecs_path_cache_fini(world);
+        flecs_path_cache_init(world);
+    }
+}
+
 
 /* Public functions */
 
@@ -47970,7 +51698,11 @@ ecs_entity_t ecs_lookup_path_w_sep(
         return e;
     }
 
-    e = flecs_name_index_find(&world->aliases, path, 0, 0);
+    /* Hash path once for the alias index and the path cache */
+    ecs_size_t path_length = ecs_os_strlen(path);
+    uint64_t path_hash = flecs_hash(path, path_length);
+
+    e = flecs_name_index_find(&world->aliases, path, path_length, path_hash);
     if (e) {
         return e;
     }
@@ -47980,7 +51712,7 @@ ecs_entity_t ecs_lookup_path_w_sep(
     char *elem = buff;
     int32_t len, size = ECS_NAME_BUFFER_LENGTH;
     ecs_entity_t cur;
-    bool lookup_path_search = false;
+    bool lookup_path_search = false, has_number;
 
     ecs_entity_t *lookup_path = ecs_get_lookup_path(stage);
     ecs_entity_t *lookup_path_cur = lookup_path;
@@ -47992,11 +51724,37 @@ ecs_entity_t ecs_lookup_path_w_sep(
         sep = ".";
     }
 
+    const char *full_path = path;
     parent = get_parent_from_path(stage, parent, &path, prefix, true);
 
+    /* Results of multi-element paths are cached, so that repeated lookups only
+     * have to hash the path once instead of resolving each element. */
+    bool use_cache = strstr(path, sep) != NULL;
+    bool write_cache = use_cache && path_cache_writable(stage);
+    ecs_path_key_t key = {0};
+    if (use_cache) {
+        if (path != full_path) {
+            /* Prefix was stripped from path */
+            path_length = ecs_os_strlen(path);
+            path_hash = flecs_hash(path, path_length);
+        }
+        key = path_key(path, path_length, path_hash, sep);
+    }
+
 retry:
+    if (use_cache) {
+        path_key_set_parent(&key, path_hash, parent);
+        ecs_entity_t *cached = flecs_hashmap_get(
+            &world->path_cache, &key, ecs_entity_t);
+        if (cached) {
+            cur = cached[0];
+            goto tail;
+        }
+    }
+
     cur = parent;
     ptr_start = ptr = path;
+    has_number = false;
 
     while ((ptr = path_elem(ptr, sep, &len))) {
         if (len < size) {
@@ -48014,12 +51772,20 @@ retry:
         elem[len] = '\0';
         ptr_start = ptr;
 
+        /* Elements that are entity ids can't be cached, as the cache isn't
+         * invalidated when unnamed entities are deleted */
+        has_number |= is_number(elem);
+
         cur = ecs_lookup_child(world, cur, elem);
         if (!cur) {
             goto tail;
         }
     }
 
+    if (write_cache && !has_number) {
+        path_cache_insert((ecs_world_t*)world, &key, cur);
+    }
+
 tail:
     if (!cur && recursive) {
         if (!lookup_path_search) {
@@ -48412,18 +52178,7 @@ ecs_id_record_t* new_id_record(
     }
 
     /* Flags for events */
-    if (flecs_check_triggers_for_event(world, id, EcsOnAdd)) {
-        idr->flags |= EcsIdHasOnAdd;
-    }
-    if (flecs_check_triggers_for_event(world, id, EcsOnRemove)) {
-        idr->flags |= EcsIdHasOnRemove;
-    }
-    if (flecs_check_triggers_for_event(world, id, EcsOnSet)) {
-        idr->flags |= EcsIdHasOnSet;
-    }
-    if (flecs_check_triggers_for_event(world, id, EcsUnSet)) {
-        idr->flags |= EcsIdHasUnSet;
-    }
+    idr->flags |= flecs_id_observed_flags(world, id);
 
     if (ecs_should_log_1()) {
         char *id_str = ecs_id_str(world, id);
@@ -33,6 +33,13 @@
 #if defined(FLECS_DEBUG) && defined(NDEBUG)
 #error "invalid configuration: cannot both define FLECS_DEBUG and NDEBUG"
 #endif
+#if defined(FLECS_HASH_JENKINS) && defined(FLECS_HASH_CUSTOM)
+#error "invalid configuration: cannot both define FLECS_HASH_JENKINS and FLECS_HASH_CUSTOM"
+#endif
+#if defined(FLECS_COLUMN_ALIGNMENT) && \
+    (FLECS_COLUMN_ALIGNMENT & (FLECS_COLUMN_ALIGNMENT - 1))
+#error "invalid configuration: FLECS_COLUMN_ALIGNMENT must be a power of two"
+#endif
 
 /* Flecs debugging enables asserts, which are used for input parameter checking
  * and cheap (constant time) sanity checks. There are lots of asserts in every
@@ -62,6 +69,36 @@
 /* FLECS_KEEP_ASSERT keeps asserts in release mode. */
 // #define FLECS_KEEP_ASSERT
 
+/* FLECS_ENTITY_CHUNK_BITS sets the number of entities per chunk in the entity
+ * index to (1 << FLECS_ENTITY_CHUNK_BITS). Larger chunks need fewer allocations
+ * and page table entries in worlds with lots of entities, but waste memory when
+ * entity ids are sparse. */
+#ifndef FLECS_ENTITY_CHUNK_BITS
+#define FLECS_ENTITY_CHUNK_BITS (12)
+#endif
+
+/* FLECS_COLUMN_ALIGNMENT aligns component columns to the specified number of 
+ * bytes, and pads them to a multiple of it. When set to the SIMD vector width 
+ * (or cache line size), systems can use aligned vector loads and stores on 
+ * columns without a remainder loop (see ecs_term_is_aligned). Must be a power 
+ * of two. */
+// #define FLECS_COLUMN_ALIGNMENT (64)
+
+/* The hash function for type id arrays (used to find tables) and names (used by
+ * the name index) is selected at build time. By default this is wyhash, which
+ * is fast for the short keys flecs hashes. FLECS_HASH_JENKINS selects Bob 
+ * Jenkins' lookup3 (the hash used by earlier versions). FLECS_HASH_CUSTOM lets
+ * the application provide the hash, by defining:
+ *   uint64_t flecs_hash_custom(const void *data, ecs_size_t length);
+ * Hashes only need to be stable within a process. */
+// #define FLECS_HASH_JENKINS
+// #define FLECS_HASH_CUSTOM
+
+/* FLECS_HUGEPAGES aligns sparse set chunks of 2MB or larger to huge pages and
+ * advises the OS (currently Linux) to back them with huge pages. To apply this
+ * to the entity index, FLECS_ENTITY_CHUNK_BITS must be 17 or larger. */
+// #define FLECS_HUGEPAGES
+
 /* The following macro's let you customize with which addons Flecs is built.
  * Without any addons Flecs is just a minimal ECS storage, but addons add 
  * features such as systems, scheduling and reflection. If an addon is disabled,
@@ -173,6 +210,7 @@ extern "C" {
 #define EcsIdTag                       (1u << 9)
 #define EcsIdWith                      (1u << 10)
 #define EcsIdUnion                     (1u << 11)
+#define EcsIdToggle                    (1u << 12)
 
 #define EcsIdHasOnAdd                  (1u << 15) /* Same values as table flags */
 #define EcsIdHasOnRemove               (1u << 16) 
@@ -258,6 +296,7 @@ extern "C" {
 #define EcsQueryIsOrphaned             (1u << 3u)  /* Is subquery orphaned */
 #define EcsQueryHasOutColumns          (1u << 4u)  /* Does query have out columns */
 #define EcsQueryHasMonitor             (1u << 5u)  /* Does query track changes */
+#define EcsQuerySkipUnchanged          (1u << 6u)  /* Only iterate changed tables */
 
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -440,6 +479,13 @@ typedef int32_t ecs_size_t;
 #define ECS_MAX(a, b) (((a) > (b)) ? a : b)
 #define ECS_MIN(a, b) (((a) < (b)) ? a : b)
 
+/* Hint the CPU to load the cache line of an address that is read soon */
+#if defined(ECS_TARGET_GNU)
+#define ECS_PREFETCH(ptr) __builtin_prefetch(ptr)
+#else
+#define ECS_PREFETCH(ptr) ((void)(ptr))
+#endif
+
 /* Abstraction on top of C-style casts so that C functions can be used in C++
  * code without producing warnings */
 #ifndef __cplusplus
@@ -1129,14 +1175,18 @@ private:
  * a 64-bit key. While it is not as fast as the sparse set, it is better at
  * handling randomly distributed values.
  *
- * Payload is stored in bucket arrays. A bucket is computed from an id by
- * using the (bucket_count - 1) as an AND-mask. The number of buckets is always
- * a power of 2. Multiple keys will be stored in the same bucket. As a result
- * the worst case retrieval performance of the map is O(n), though this is rare.
- * On average lookup performance should equal O(1).
+ * The map uses open addressing. Keys and payloads are stored inline in arrays
+ * of slots, next to an array with one control byte per slot. A control byte
+ * stores 7 bits of the key hash, or marks the slot as empty or deleted.
+ * Lookups probe groups of 16 control bytes at a time (with SSE2 where 
+ * available), and only compare keys of slots with a matching hash tag. Most 
+ * lookups touch a single group and a single slot.
  *
- * The datastructure will automatically grow the number of buckets when the
- * ratio between elements and buckets exceeds a certain threshold (LOAD_FACTOR).
+ * The number of slots is always a power of 2. The map grows when more than
+ * 7/8th of the slots are in use. Removing an element leaves a tombstone if a
+ * probe sequence could pass through its slot, so that removing elements while
+ * iterating a map is allowed. Adding elements may move existing elements, which
+ * invalidates pointers to payloads returned by earlier operations.
  *
  * Note that while the implementation is a hashmap, it can only compute hashes
  * for the provided 64 bit keys. This means that the provided keys must always
@@ -1158,48 +1208,21 @@ extern "C" {
 typedef uint64_t ecs_map_key_t;
 
 /* Map type */
-typedef struct ecs_bucket_entry_t {
-    struct ecs_bucket_entry_t *next;
-    ecs_map_key_t key;
-    /* payload right after key. */
-} ecs_bucket_entry_t;
-
-typedef struct ecs_block_allocator_block_t {
-    void *memory;
-    struct ecs_block_allocator_block_t *next;
-} ecs_block_allocator_block_t;
-
-typedef struct ecs_block_allocator_chunk_header_t {
-    struct ecs_block_allocator_chunk_header_t *next;
-} ecs_block_allocator_chunk_header_t;
-
-typedef struct ecs_block_allocator_t {
-    ecs_block_allocator_chunk_header_t *head;
-    ecs_block_allocator_block_t *block_head;
-    ecs_block_allocator_block_t *block_tail;
-    int32_t chunk_size;
-    int32_t chunks_per_block;
-    int32_t block_size;
-} ecs_block_allocator_t;
-
-typedef struct ecs_bucket_t {
-    ecs_bucket_entry_t *first;
-} ecs_bucket_t;
-
 typedef struct ecs_map_t {
-    ecs_bucket_t *buckets;
-    ecs_bucket_t *buckets_end;
+    uint8_t *ctrl;          /* Control byte per slot (hash, empty, deleted) */
+    ecs_map_key_t *keys;    /* Key for each slot */
+    void *payloads;         /* Payload for each slot */
     int16_t elem_size;
+    int16_t payload_size;
     uint8_t bucket_shift;
-    int32_t bucket_count;
+    int32_t bucket_count;   /* Number of slots */
     int32_t count;
-    ecs_block_allocator_t allocator;
+    int32_t growth_left;    /* Empty slots that can be used before growing */
 } ecs_map_t;
 
 typedef struct ecs_map_iter_t {
     const ecs_map_t *map;
-    ecs_bucket_t *bucket;
-    ecs_bucket_entry_t *entry;
+    int32_t index;
 } ecs_map_iter_t;
 
 #define ECS_MAP_INIT(T) { .elem_size = ECS_SIZEOF(T) }
@@ -1307,7 +1330,7 @@ FLECS_API
 int32_t ecs_map_count(
     const ecs_map_t *map);
 
-/** Return number of buckets in map. */
+/** Return number of slots in map. */
 FLECS_API
 int32_t ecs_map_bucket_count(
     const ecs_map_t *map);
@@ -1336,13 +1359,13 @@ void* _ecs_map_next_ptr(
 #define ecs_map_next_ptr(iter, T, key) \
     (T)_ecs_map_next_ptr(iter, key)
 
-/** Grow number of buckets in the map for specified number of elements. */
+/** Grow number of slots in the map for specified number of elements. */
 FLECS_API
 void ecs_map_grow(
     ecs_map_t *map,
     int32_t elem_count);
 
-/** Set number of buckets in the map for specified number of elements. */
+/** Set number of slots in the map for specified number of elements. */
 FLECS_API
 void ecs_map_set_size(
     ecs_map_t *map,
@@ -1430,6 +1453,12 @@ typedef struct ecs_strbuf_list_elem {
     const char *separator;
 } ecs_strbuf_list_elem;
 
+/* Callback that receives buffer contents when a flushing buffer fills up */
+typedef void (*ecs_strbuf_flush_action_t)(
+    const char *str,
+    int32_t len,
+    void *ctx);
+
 typedef struct ecs_strbuf_t {
     /* When set by an application, append will write to this buffer */
     char *buf;
@@ -1459,6 +1488,12 @@ typedef struct ecs_strbuf_t {
 
     /* This is set to the output string length after calling ecs_strbuf_get */
     int32_t length;
+
+    /* When set, a full element is passed to this callback and reused instead
+     * of allocating a new one. This bounds memory used by the buffer to a 
+     * single element, regardless of how much is written. */
+    ecs_strbuf_flush_action_t flush;
+    void *flush_ctx;
 } ecs_strbuf_t;
 
 /* Append format string to a buffer.
@@ -1499,6 +1534,38 @@ bool ecs_strbuf_appendflt(
     double v,
     char nan_delim);
 
+/* Append binary data to buffer. Unlike ecs_strbuf_appendstrn, data may 
+ * contain \0 characters. 
+ * Returns false when max is reached, true when there is still space */
+FLECS_API
+bool ecs_strbuf_appendbin(
+    ecs_strbuf_t *buffer,
+    const void *data,
+    int32_t n);
+
+/* Append single precision float to buffer. Uses the shortest representation
+ * that round trips to the same single precision value.
+ * Returns false when max is reached, true when there is still space */
+FLECS_API
+bool ecs_strbuf_appendflt32(
+    ecs_strbuf_t *buffer,
+    float v,
+    char nan_delim);
+
+/* Append signed integer to buffer.
+ * Returns false when max is reached, true when there is still space */
+FLECS_API
+bool ecs_strbuf_appendint(
+    ecs_strbuf_t *buffer,
+    int64_t v);
+
+/* Append unsigned integer to buffer.
+ * Returns false when max is reached, true when there is still space */
+FLECS_API
+bool ecs_strbuf_appenduint(
+    ecs_strbuf_t *buffer,
+    uint64_t v);
+
 /* Append source buffer to destination buffer.
  * Returns false when max is reached, true when there is still space */
 FLECS_API
@@ -1533,6 +1600,11 @@ FLECS_API
 char *ecs_strbuf_get(
     ecs_strbuf_t *buffer);
 
+/* Pass remaining contents to flush callback */
+FLECS_API
+void ecs_strbuf_flush(
+    ecs_strbuf_t *buffer);
+
 /* Return small string from first element (appends \0) */
 FLECS_API
 char *ecs_strbuf_get_small(
@@ -2607,6 +2679,11 @@ typedef struct ecs_worker_iter_t {
     int32_t count;
 } ecs_worker_iter_t;
 
+/* Changed-iterator specific data */
+typedef struct ecs_changed_iter_t {
+    int32_t frame;
+} ecs_changed_iter_t;
+
 /* Convenience struct to iterate table array for id */
 typedef struct ecs_table_cache_iter_t {
     struct ecs_table_cache_hdr_t *cur, *next;
@@ -2656,7 +2733,7 @@ typedef struct ecs_filter_iter_t {
 /** Query-iterator specific data */
 typedef struct ecs_query_iter_t {
     ecs_query_t *query;
-    ecs_query_table_node_t *node, *prev;
+    ecs_query_table_node_t *node, *prev, *last;
     int32_t sparse_smallest;
     int32_t sparse_first;
     int32_t bitset_first;
@@ -2689,6 +2766,9 @@ typedef struct ecs_rule_iter_t {
     
     ecs_entity_t entity;                 /* Result in case of 1 entity */
 
+    int32_t union_row;                   /* Next row to test for union cases */
+    int32_t union_end;                   /* End of rows to test for union cases */
+
     bool redo;
     int32_t op;
     int32_t sp;
@@ -2731,6 +2811,7 @@ typedef struct ecs_iter_private_t {
         ecs_snapshot_iter_t snapshot;
         ecs_page_iter_t page;
         ecs_worker_iter_t worker;
+        ecs_changed_iter_t changed;
     } iter;                       /* Iterator specific data */
 
     ecs_iter_cache_t cache;       /* Inline arrays to reduce allocations */
@@ -2772,6 +2853,7 @@ struct ecs_iter_t {
                                    * of a trigger/observer term. */
     int32_t variable_count;       /* Number of variables for query */
     char **variable_names;        /* Names of variables (if any) */
+    uint64_t group_id;            /* Group of current table (if query uses group_by) */
 
     /* Context */
     void *param;                  /* Param passed to ecs_run */
@@ -2955,6 +3037,7 @@ struct ecs_sparse_t {
 
     ecs_vector_t *chunks;       /* Chunks with sparse arrays & data */
     ecs_size_t size;            /* Element size */
+    int32_t chunk_bits;         /* Number of elements per chunk (log2) */
     int32_t count;              /* Number of alive entries */
     uint64_t max_id_local;      /* Local max index (if no global is set) */
     uint64_t *max_id;           /* Maximum issued sparse index */
@@ -3001,6 +3084,13 @@ void flecs_sparse_set_id_source(
     ecs_sparse_t *sparse,
     uint64_t *id_source);
 
+/** Set number of elements per chunk to (1 << chunk_bits). Can only be set while
+ * the sparse set has no chunks. */
+FLECS_DBG_API
+void flecs_sparse_set_chunk_bits(
+    ecs_sparse_t *sparse,
+    int32_t chunk_bits);
+
 /** Add element to sparse set, this generates or recycles an id */
 FLECS_DBG_API
 void* _flecs_sparse_add(
@@ -3109,6 +3199,13 @@ void* _flecs_sparse_get_any(
 #define flecs_sparse_get_any(sparse, T, index)\
     ((T*)_flecs_sparse_get_any(sparse, ECS_SIZEOF(T), index))
 
+/** Prefetch the sparse & data entries for an id. Use when looking up a batch of
+ * ids, so that memory latency overlaps with the processing of previous ids. */
+FLECS_DBG_API
+void flecs_sparse_prefetch(
+    const ecs_sparse_t *sparse,
+    uint64_t id);
+
 /** Get or create element by (sparse) id. */
 FLECS_DBG_API
 void* _flecs_sparse_ensure(
@@ -3532,7 +3629,12 @@ typedef struct ecs_query_desc_t {
      * will not be grouped. When set, this callback will be used to calculate a
      * "rank" for each entity (table) based on its components. This rank is then
      * used to sort entities (tables), so that entities (tables) of the same
-     * rank are "grouped" together when iterated. */
+     * rank are "grouped" together when iterated. 
+     * 
+     * If the callback is not set but group_by_id is, results are grouped by
+     * the object of the (group_by_id, *) relation. Tables without the relation
+     * are put in group 0. This can be used to partition entities, for example
+     * by adding a (Cell, cell_entity) pair for the grid cell of an entity. */
     ecs_group_by_action_t group_by;
 
     /* Context to pass to group_by */
@@ -3781,6 +3883,7 @@ typedef struct ecs_world_info_t {
     FLECS_FLOAT frame_time_total;     /* Total time spent processing a frame */
     float system_time_total;          /* Total time spent in systems */
     float merge_time_total;           /* Total time spent in merges */
+    float pipeline_build_time_total;  /* Total time spent building pipelines */
     FLECS_FLOAT world_time_total;     /* Time elapsed in simulation */
     FLECS_FLOAT world_time_total_raw; /* Time elapsed in simulation (no scaling) */
     
@@ -3791,6 +3894,9 @@ typedef struct ecs_world_info_t {
     int32_t id_delete_total;          /* Total number of times an id was deleted */
     int32_t table_create_total;       /* Total number of times a table was created */
     int32_t table_delete_total;       /* Total number of times a table was deleted */
+    int32_t table_realloc_total;      /* Total number of times table storage was reallocated */
+    int32_t event_emit_total;         /* Total number of add/remove/set events emitted to triggers */
+    int32_t event_skip_total;         /* Total number of add/remove/set events skipped because no triggers were observing the ids */
     int32_t pipeline_build_count_total; /* Total number of pipeline builds */
     int32_t systems_ran_frame;  /* Total number of systems ran in last frame */
 
@@ -3982,6 +4088,11 @@ FLECS_API extern const ecs_entity_t EcsTag;
  * are also marked as exclusive. */
 FLECS_API extern const ecs_entity_t EcsUnion;
 
+/* Tag to indicate that a component can be toggled. Tables with a toggleable 
+ * component always store an enabled bit per entity for it, so enabling and
+ * disabling the component is a bit flip and never moves the entity. */
+FLECS_API extern const ecs_entity_t EcsToggle;
+
 /* Tag to indicate name identifier */
 FLECS_API extern const ecs_entity_t EcsName;
 
@@ -4512,6 +4623,53 @@ int32_t ecs_delete_empty_tables(
     int32_t min_id_count,
     double time_budget_seconds);
 
+/** Enable automatic cleanup of empty tables.
+ * This operation configures ecs_frame_end to incrementally clean up empty 
+ * tables, with the same rules as ecs_delete_empty_tables. Each frame resumes
+ * where the previous frame stopped, and visits each table at most once. As the
+ * generation of a table is reset when it becomes non empty, a table is cleared
+ * or deleted once it has been empty for the specified number of frames.
+ * 
+ * When the time budget does not allow visiting all tables in a single frame, a
+ * table will take more frames to reach the specified generation.
+ * 
+ * Non-empty tables that use less than a quarter of their storage for more than
+ * clear_generation frames are shrunk. Shrinking leaves room for the table to
+ * double, and never goes below the reservation of a table (see ecs_reserve_id).
+ * 
+ * Setting both the clear and delete generation to 0 disables cleanup.
+ * 
+ * @param world The world.
+ * @param clear_generation Free table data when generation > clear_generation.
+ * @param delete_generation Delete table when generation > delete_generation.
+ * @param time_budget_seconds Amount of time cleanup may spend per frame.
+ */
+FLECS_API
+void ecs_set_empty_table_gc(
+    ecs_world_t *world,
+    uint16_t clear_generation,
+    uint16_t delete_generation,
+    double time_budget_seconds);
+
+/** Reserve storage for tables with id.
+ * This operation ensures that tables with the specified id have storage for at
+ * least the specified number of entities. Existing tables are resized when
+ * their storage is smaller than count, new tables are resized when the first
+ * entity is added. Table storage is never shrunk below the reservation.
+ * 
+ * A table with multiple reserved ids uses the largest reservation. Reducing
+ * the reservation for an id only applies to tables created afterwards.
+ *
+ * @param world The world.
+ * @param id The id for which to reserve storage.
+ * @param count The number of entities to reserve storage for.
+ */
+FLECS_API
+void ecs_reserve_id(
+    ecs_world_t *world,
+    ecs_id_t id,
+    int32_t count);
+
 /** @} */
 
 /**
@@ -4871,6 +5029,28 @@ const void* ecs_get_id(
     ecs_entity_t entity,
     ecs_id_t id);
 
+/** Get immutable pointers to a component for multiple entities.
+ * This operation returns the same pointers as calling ecs_get_id for each 
+ * entity, but is faster for entities that are not accessed in storage order.
+ * Entity index lookups for a batch of entities are prefetched before they are
+ * read, which overlaps their cache misses. Component data is prefetched before
+ * the operation returns.
+ *
+ * @param world The world.
+ * @param entities Array with entities.
+ * @param count Number of entities.
+ * @param id The id of the component to get.
+ * @param ptrs_out Array with count elements that receives the component 
+ *        pointers. An element is NULL if the entity does not have the component.
+ */
+FLECS_API
+void ecs_get_id_n(
+    const ecs_world_t *world,
+    const ecs_entity_t *entities,
+    int32_t count,
+    ecs_id_t id,
+    const void **ptrs_out);
+
 /** Create a ref.
  * A ref is a handle to an entity + component which caches a small amount of
  * data to reduce overhead of repeatedly accessing the component. Use 
@@ -6301,6 +6481,23 @@ FLECS_API
 void ecs_query_skip(
     ecs_iter_t *it);
 
+/** Limit query iterator to a single group.
+ * This operation limits the results returned by a query iterator to the tables
+ * in the specified group. The query must use group_by, and cannot be sorted.
+ * Groups only exist while they contain non-empty tables, so iterating an
+ * empty group returns no results without visiting any tables.
+ * 
+ * The operation must be called after creating the iterator, and before the
+ * first call to ecs_query_next.
+ * 
+ * @param it The query iterator.
+ * @param group_id The group to iterate.
+ */
+FLECS_API
+void ecs_query_set_group(
+    ecs_iter_t *it,
+    uint64_t group_id);
+
 /** Returns whether query is orphaned.
  * When the parent query of a subquery is deleted, it is left in an orphaned
  * state. The only valid operation on an orphaned query is deleting it. Only
@@ -6781,6 +6978,41 @@ FLECS_API
 bool ecs_worker_next(
     ecs_iter_t *it);
 
+/** Create a changed iterator.
+ * Changed iterators only return results from tables that changed since the
+ * specified frame (see ecs_world_info_t::frame_count_total). A table changes
+ * when entities are added to or removed from it, or when one of its component
+ * columns is written to by ecs_modified or by a system with write access.
+ * 
+ * Change tracking for a table starts the first time it is evaluated by a
+ * changed iterator or a query that uses change detection. Tables for which 
+ * no changes were tracked yet are always returned.
+ * 
+ * The iterator must be iterated with ecs_changed_next.
+ * 
+ * A changed iterator acts as a passthrough for data exposed by the parent
+ * iterator, so that any data provided by the parent will also be provided by
+ * the changed iterator.
+ * 
+ * @param it The source iterator.
+ * @param frame Only return tables that changed in or after this frame.
+ * @return A changed iterator.
+ */
+FLECS_API
+ecs_iter_t ecs_changed_iter(
+    const ecs_iter_t *it,
+    int32_t frame);
+
+/** Progress a changed iterator.
+ * Progresses an iterator created by ecs_changed_iter.
+ * 
+ * @param it The iterator.
+ * @return true if iterator has more results, false if not.
+ */
+FLECS_API
+bool ecs_changed_next(
+    ecs_iter_t *it);
+
 /** Obtain data for a query term.
  * This operation retrieves a pointer to an array of data that belongs to the
  * term in the query. The index refers to the location of the term in the query,
@@ -6863,6 +7095,26 @@ bool ecs_term_is_owned(
     const ecs_iter_t *it,
     int32_t index);
 
+/** Test whether term data is aligned for vector access.
+ * When Flecs is built with FLECS_COLUMN_ALIGNMENT, component columns start at
+ * an address aligned to FLECS_COLUMN_ALIGNMENT, and are padded to a multiple of
+ * it. This operation returns true if the term is owned and its data is aligned,
+ * which is the case when the result starts at the first row of a table.
+ * 
+ * When a term is aligned, vectors of FLECS_COLUMN_ALIGNMENT bytes may be loaded
+ * and stored up to and including the vector that contains the last element.
+ * Elements in the padding are not initialized, and are not preserved when the
+ * table is resized.
+ *
+ * @param it The iterator.
+ * @param index The index of the term in the query.
+ * @return Whether the term data is aligned and padded.
+ */
+FLECS_API
+bool ecs_term_is_aligned(
+    const ecs_iter_t *it,
+    int32_t index);
+
 /** Convert iterator to string.
  * Prints the contents of an iterator to a string. Useful for debugging and/or
  * testing the output of an iterator.
@@ -7729,6 +7981,9 @@ void* ecs_record_get_column(
 #define ecs_get(world, entity, T)\
     (ECS_CAST(const T*, ecs_get_id(world, entity, ecs_id(T))))
 
+#define ecs_get_n(world, entities, count, T, ptrs_out)\
+    ecs_get_id_n(world, entities, count, ecs_id(T), (const void**)(ptrs_out))
+
 #define ecs_get_pair(world, subject, relation, object)\
     (ECS_CAST(relation*, ecs_get_id(world, subject,\
         ecs_pair(ecs_id(relation), object))))
@@ -9003,6 +9258,14 @@ void FlecsTimerImport(
  * EcsPostUpdate etc.) that are registered with the builtin pipeline. The 
  * builtin pipeline is ran by default when calling ecs_progress(). An 
  * application can set a custom pipeline with the ecs_set_pipeline function.
+ *
+ * Systems in a phase run in the order they are declared, except that 
+ * concurrent systems may be reordered to share a merge, if their queries don't
+ * access the same data. Concurrent systems are never moved past a system that
+ * isn't concurrent, or a system with no_staging, no terms or a custom run 
+ * action. Merges are inserted where a system reads data written by an earlier
+ * system, where the staging mode changes, and between single and multi 
+ * threaded systems that may access the same data.
  */
 
 #ifdef FLECS_PIPELINE
@@ -9155,7 +9418,14 @@ void ecs_deactivate_systems(
  * Setting this value to a value higher than 1 will start as many threads and
  * will cause systems to evenly distribute matched entities across threads. The
  * operation may be called multiple times to reconfigure the number of threads
- * used, but never while running a system / pipeline. */
+ * used, but never while running a system / pipeline. 
+ *
+ * Systems that are not multi threaded are assigned to a single worker. Systems
+ * created with concurrent set to true may run on different workers at the same
+ * time, if they are between the same merge points and their queries don't
+ * access the same data (with at least one of them writing). Other single 
+ * threaded systems run on the first worker, and prevent concurrent systems
+ * between the same merge points from running on other workers. */
 FLECS_API
 void ecs_set_threads(
     ecs_world_t *world,
@@ -9319,6 +9589,24 @@ typedef struct ecs_system_desc_t {
     /* If true, system will have access to actuall world. Cannot be true at the
      * same time as multi_threaded. */
     bool no_staging;
+
+    /* If true, the system only accesses data through its query. This allows
+     * the pipeline to reorder it with other concurrent systems in its phase,
+     * and to run it on another worker at the same time as other concurrent
+     * systems that don't access the same components. Commands of systems on
+     * different workers are merged in the order of the workers instead of
+     * pipeline order. Has no effect for no_staging systems. */
+    bool concurrent;
+
+    /* If true, system is only invoked for tables of which the input columns
+     * changed, or that gained or lost entities since the system last ran. The
+     * system's own writes to its inout columns are not counted as changes.
+     * Union relations are tracked per column, so changing the case of one
+     * entity counts as a change of union terms for the whole table. This
+     * includes case changes made by the system itself, which run the system
+     * again in the next frame.
+     * Cannot be combined with multi_threaded or a sorted query. */
+    bool skip_unchanged;
 } ecs_system_desc_t;
 
 /* Create a system */
@@ -11623,12 +11911,15 @@ typedef struct ecs_world_stats_t {
     ecs_gauge_t table_storage_count;          /* Number of table storages */
     ecs_counter_t table_create_count;         /* Number of times table has been created */
     ecs_counter_t table_delete_count;         /* Number of times table has been deleted */
+    ecs_counter_t table_realloc_count;        /* Number of times table storage was reallocated */
 
     /* Queries & events */
     ecs_gauge_t query_count;                  /* Number of queries */
     ecs_gauge_t trigger_count;                /* Number of triggers */
     ecs_gauge_t observer_count;               /* Number of observers */
     ecs_gauge_t system_count;                 /* Number of systems */
+    ecs_counter_t event_emit_count;           /* Number of add/remove/set events emitted to triggers */
+    ecs_counter_t event_skip_count;           /* Number of add/remove/set events skipped because the ids weren't observed */
 
     /* Deferred operations */
     ecs_counter_t new_count;
@@ -11646,6 +11937,7 @@ typedef struct ecs_world_stats_t {
     ecs_counter_t frame_time_total;           /* Time spent processing a frame. Smaller than world_time_total when load is not 100% */
     ecs_counter_t system_time_total;          /* Time spent on processing systems. */
     ecs_counter_t merge_time_total;           /* Time spent on merging deferred actions. */
+    ecs_counter_t pipeline_build_time_total;  /* Time spent on rebuilding system pipelines. */
     ecs_gauge_t fps;                          /* Frames per second. */
     ecs_gauge_t delta_time;                   /* Delta_time. */
     
@@ -11694,6 +11986,7 @@ typedef struct ecs_pipeline_stats_t {
 
     int32_t system_count; /* Number of systems in pipeline */
     int32_t active_system_count; /* Number of active systems in pipeline */
+    int32_t merge_count; /* Number of merges per frame */
     int32_t rebuild_count; /* Number of times pipeline has rebuilt */
 } ecs_pipeline_stats_t;
 
@@ -11961,6 +12254,9 @@ extern "C" {
 /** HTTP server */
 typedef struct ecs_http_server_t ecs_http_server_t;
 
+/** Stream that pushes data to a client after a request was handled */
+typedef struct ecs_http_stream_t ecs_http_stream_t;
+
 /** A connection manages communication with the remote host */
 typedef struct {
     uint64_t id;
@@ -12008,10 +12304,11 @@ typedef struct {
     const char* status;         /* default = OK */
     const char* content_type;   /* default = application/json */
     ecs_strbuf_t headers;       /* default = "" */
+    bool chunked;               /* default = false, see ecs_http_reply_chunked */
 } ecs_http_reply_t;
 
 #define ECS_HTTP_REPLY_INIT \
-    (ecs_http_reply_t){200, ECS_STRBUF_INIT, "OK", "application/json", ECS_STRBUF_INIT}
+    (ecs_http_reply_t){200, ECS_STRBUF_INIT, "OK", "application/json", ECS_STRBUF_INIT, false}
 
 /** Request callback.
  * Invoked for each valid request. The function should populate the reply and
@@ -12079,6 +12376,106 @@ FLECS_API
 void ecs_http_server_stop(
     ecs_http_server_t* server);
 
+/** Stream reply with chunked transfer encoding.
+ * This sends the reply headers immediately, after which content appended to
+ * the reply body is sent to the client in fixed-size chunks as the buffer 
+ * fills up. This bounds the memory used by a reply to the chunk size, which
+ * makes it possible to send replies that are larger than what would fit in 
+ * memory. The reply code, status, content type and headers must be set before
+ * calling this function.
+ * 
+ * @param req The request.
+ * @param reply The reply.
+ * @return Zero if successful, non-zero if the headers could not be sent, in
+ *         which case the connection is closed and no reply is sent.
+ */
+FLECS_API
+int ecs_http_reply_chunked(
+    const ecs_http_request_t* req,
+    ecs_http_reply_t *reply);
+
+/** Abort chunked reply.
+ * Use this when an error occurs after ecs_http_reply_chunked was called. Since
+ * the reply headers have already been sent, the error can't be reported with a
+ * status code. Instead content that was not yet sent is discarded, and the
+ * connection is closed without sending the terminating chunk. This lets the 
+ * client detect that the reply is incomplete.
+ * 
+ * @param reply The chunked reply.
+ */
+FLECS_API
+void ecs_http_reply_abort(
+    ecs_http_reply_t *reply);
+
+/** Open a stream for a request.
+ * A stream keeps the connection of a request open after the request callback
+ * has returned, so that an application can push data to the client, for
+ * example to implement server-sent events. The reply headers are sent
+ * immediately, after which the reply should no longer be used.
+ * 
+ * Data is sent on a non-blocking socket. Data that can't be sent right away
+ * is stored in a queue with the specified size. When a client doesn't read
+ * fast enough and the queue fills up, new data is dropped until the client 
+ * catches up. Dropped data is counted, see ecs_http_stream_dropped.
+ * 
+ * Streams must be used from the thread that dequeues requests, and must be
+ * closed with ecs_http_stream_close.
+ * 
+ * @param req The request.
+ * @param reply The reply.
+ * @param queue_size Max number of bytes to queue for a slow client.
+ * @return The stream, or NULL if the stream could not be opened.
+ */
+FLECS_API
+ecs_http_stream_t* ecs_http_stream_open(
+    const ecs_http_request_t* req,
+    ecs_http_reply_t *reply,
+    ecs_size_t queue_size);
+
+/** Send data to a stream.
+ * The data is sent as a single chunk. If the chunk doesn't fit in the queue
+ * of the stream it is dropped as a whole. A chunk that is larger than the
+ * queue size is only accepted when the queue is empty.
+ * 
+ * @param stream The stream.
+ * @param data The data to send.
+ * @param len The number of bytes to send.
+ * @return Zero if sent or queued, one if dropped, -1 if the stream is closed.
+ */
+FLECS_API
+int ecs_http_stream_send(
+    ecs_http_stream_t *stream,
+    const char *data,
+    ecs_size_t len);
+
+/** Send data queued for a stream.
+ * This attempts to send data that could not be sent by a previous call to
+ * ecs_http_stream_send, without blocking.
+ * 
+ * @param stream The stream.
+ * @return Zero if successful, -1 if the stream is closed.
+ */
+FLECS_API
+int ecs_http_stream_flush(
+    ecs_http_stream_t *stream);
+
+/** Return number of chunks dropped for a stream.
+ * 
+ * @param stream The stream.
+ * @return The number of chunks that were dropped because the queue was full.
+ */
+FLECS_API
+int32_t ecs_http_stream_dropped(
+    const ecs_http_stream_t *stream);
+
+/** Close a stream.
+ * 
+ * @param stream The stream.
+ */
+FLECS_API
+void ecs_http_stream_close(
+    ecs_http_stream_t *stream);
+
 /** Find header in request. 
  * 
  * @param req The request.
@@ -12517,6 +12914,7 @@ static const flecs::entity_t Final = EcsFinal;
 static const flecs::entity_t DontInherit = EcsDontInherit;
 static const flecs::entity_t Tag = EcsTag;
 static const flecs::entity_t Union = EcsUnion;
+static const flecs::entity_t Toggle = EcsToggle;
 static const flecs::entity_t Exclusive = EcsExclusive;
 static const flecs::entity_t Acyclic = EcsAcyclic;
 static const flecs::entity_t Symmetric = EcsSymmetric;
@@ -15237,6 +15635,31 @@ struct world {
         ecs_dim(m_world, entity_count);
     }
 
+    /** Enable automatic cleanup of empty tables.
+     * @see ecs_set_empty_table_gc
+     */
+    void set_empty_table_gc(uint16_t clear_generation, 
+        uint16_t delete_generation, double time_budget_seconds = 0) const 
+    {
+        ecs_set_empty_table_gc(m_world, clear_generation, delete_generation,
+            time_budget_seconds);
+    }
+
+    /** Reserve storage for tables with id.
+     * @see ecs_reserve_id
+     */
+    void reserve(id_t id, int32_t count) const {
+        ecs_reserve_id(m_world, id, count);
+    }
+
+    /** Reserve storage for tables with component.
+     * @see ecs_reserve_id
+     */
+    template <typename T>
+    void reserve(int32_t count) const {
+        ecs_reserve_id(m_world, _::cpp_type<T>::id(m_world), count);
+    }
+
     /** Set entity range.
      * This function limits the range of issued entity ids between min and max.
      *
@@ -15330,6 +15753,17 @@ struct world {
      */
     template <typename T>
     const T* get() const;
+
+    /** Get component for multiple entities.
+     * @see ecs_get_id_n
+     */
+    template <typename T>
+    void get_n(const flecs::entity_t *entities, int32_t count, 
+        const T **ptrs_out) const 
+    {
+        ecs_get_id_n(m_world, entities, count, _::cpp_type<T>::id(m_world),
+            reinterpret_cast<const void**>(ptrs_out));
+    }
     
     /** Get singleton component inside a callback.
      */
@@ -16342,6 +16776,15 @@ public:
         return ecs_term_is_readonly(m_iter, index);
     }
 
+    /** Returns whether term data is aligned for vector access.
+     * @see ecs_term_is_aligned
+     *
+     * @param index The term index.
+     */
+    bool is_aligned(int32_t index) const {
+        return ecs_term_is_aligned(m_iter, index);
+    }
+
     /** Number of terms in iteator.
      */
     int32_t term_count() const {
@@ -16464,6 +16907,12 @@ public:
         return m_iter->table_count;
     }
 
+    /** Obtain the group of the current table, if the query uses group_by.
+     */
+    uint64_t group_id() const {
+        return m_iter->group_id;
+    }
+
     /** Obtain untyped pointer to table column.
      *
      * @param column Id of table column (corresponds with location in table type).
@@ -21328,6 +21777,28 @@ public:
         return *this;
     } 
 
+    /** Group matched tables by relation object.
+     * Tables are grouped by the object of the (R, *) relation, so that tables
+     * with the same object are iterated together.
+     *
+     * @tparam R The relation used to determine the group.
+     */
+    template <typename R>
+    Base& group_by() {
+        return this->group_by(_::cpp_type<R>::id(this->world_v()));
+    }
+
+    /** Group matched tables by relation object.
+     * Same as group_by<R>, but with relation identifier.
+     *
+     * @param relation The relation used to determine the group.
+     */
+    Base& group_by(flecs::entity_t relation) {
+        m_desc->group_by = nullptr;
+        m_desc->group_by_id = relation;
+        return *this;
+    }
+
     /** Specify parent query (creates subquery) */
     Base& parent(const query_base& parent);
     
@@ -21992,6 +22463,26 @@ public:
         return *this;
     }
 
+    /** Specify whether system only accesses data through its query.
+     *
+     * @param value If true system may be reordered with and run in parallel
+     *              with other concurrent systems that don't access the same
+     *              data.
+     */
+    Base& concurrent(bool value = true) {
+        m_desc->concurrent = value;
+        return *this;
+    }
+
+    /** Specify whether system should only run for changed tables.
+     *
+     * @param value If true, system skips tables of which inputs didn't change.
+     */
+    Base& skip_unchanged(bool value = true) {
+        m_desc->skip_unchanged = value;
+        return *this;
+    }
+
     /** Set system interval.
      * This operation will cause the system to be ran at the specified interval.
      *
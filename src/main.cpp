@@ -108,6 +108,42 @@ int app(int argc, char *argv[]) {
     ecs.component<Happiness>()
         .member<float, flecs::units::Percentage>("value");
 
+    // Status enums change often, store them as union so that changing the
+    // status of an entity doesn't move it to another table.
+    ecs.component<PlateStatus>().add(flecs::Union);
+    ecs.component<TableStatus>().add(flecs::Union);
+    ecs.component<ChefStatus>().add(flecs::Union);
+    ecs.component<WaiterStatus>().add(flecs::Union);
+
+    // Assignments to tables, plates and waiters point to a single entity. As
+    // union relationships the target is stored in a column, so that adding a
+    // pair doesn't create a table for each target entity.
+    ecs.component<Table>().add(flecs::Union);
+    ecs.component<Plate>().add(flecs::Union);
+    ecs.component<Waiter>().add(flecs::Union);
+
+    // Union cases are matched per entity by cached queries only
+    auto free_tables = ecs.query_builder()
+        .term<Table>()
+        .term<TableStatus>(TableStatus::Unoccupied)
+        .build();
+
+    auto idle_chefs = ecs.query_builder()
+        .term<Chef>()
+        .term<ChefStatus>(ChefStatus::Idle)
+        .build();
+
+    auto idle_waiters = ecs.query_builder()
+        .term<Waiter>()
+        .term<WaiterStatus>(WaiterStatus::Idle)
+        .build();
+
+    // Rules match union cases, which lets them look up the plate for a table
+    auto table_plate = ecs.rule_builder()
+        .term<Plate>()
+        .term<Table>().obj().var("table")
+        .build();
+
     // Root scopes
     auto tables = ecs.entity("::tables");
     auto chefs = ecs.entity("::chefs");
@@ -150,17 +186,13 @@ int app(int argc, char *argv[]) {
     // Guest generator
     ecs.system("systems::GuestGenerator")
         .interval(GuestFrequency)
-        .iter([](flecs::iter& it) {
+        .iter([free_tables](flecs::iter& it) {
             flecs::entity table;
 
             // Find free table
-            it.world().filter_builder()
-                .term<Table>()
-                .term<TableStatus>(TableStatus::Unoccupied)
-                .build()
-                .each([&](flecs::entity t) {
-                    table = t;
-                });
+            free_tables.each([&](flecs::entity t) {
+                table = t.mut(it);
+            });
 
             if (table) {
                 table.add(TableStatus::Unassigned);
@@ -179,12 +211,7 @@ int app(int argc, char *argv[]) {
         .term<Table>()
         .term<TableStatus>(TableStatus::Unassigned)
         .no_staging()
-        .iter([](flecs::iter& it) {
-            auto idle_chefs = it.world().filter_builder()
-                .term<Chef>()
-                .term<ChefStatus>(ChefStatus::Idle)
-                .build();
-
+        .iter([idle_chefs](flecs::iter& it) {
             for (int i : it) {
                 flecs::entity table = it.entity(i);
 
@@ -263,12 +290,7 @@ int app(int argc, char *argv[]) {
         .term<Waiter>(flecs::Wildcard).oper(flecs::Not)
         .term<PlateStatus>(PlateStatus::Ready)
         .no_staging()
-        .iter([](flecs::iter& it) {
-            auto idle_waiters = it.world().filter_builder()
-                .term<Waiter>()
-                .term<WaiterStatus>(WaiterStatus::Idle)
-                .build();
-
+        .iter([idle_waiters](flecs::iter& it) {
             for (int i : it) {
                 flecs::entity plate = it.entity(i);
 
@@ -316,7 +338,7 @@ int app(int argc, char *argv[]) {
     ecs.system<DistanceFromKitchen>("systems::WaiterToKitchen")
         .term<Waiter>()
         .term<WaiterStatus>(WaiterStatus::WalkingToKitchen)
-        .each([](flecs::iter& it, size_t index, DistanceFromKitchen& d) {
+        .each([table_plate](flecs::iter& it, size_t index, DistanceFromKitchen& d) {
             d.value -= WaiterSpeed * it.delta_time();
             if (d.value <= 0) {
                 d.value = 0;
@@ -326,10 +348,8 @@ int app(int argc, char *argv[]) {
 
                 // Find plate for table (should be only one)
                 flecs::entity plate;
-                it.world().filter_builder()
-                    .term<Plate>()
-                    .term<Table>(table)
-                    .build()
+                table_plate.iter()
+                    .set_var("table", table)
                     .each([&](flecs::entity e) {
                         plate = e;
                     });
@@ -406,6 +426,20 @@ int app(int argc, char *argv[]) {
             }
         });
 
+    // Reserve storage so that entities moving between tables don't cause
+    // reallocations. There is at most one plate per table.
+    ecs.reserve<Table>(TableXCount * TableYCount);
+    ecs.reserve<Plate>(TableXCount * TableYCount);
+    ecs.reserve<Chef>(ChefCount);
+    ecs.reserve<Waiter>(WaiterCount);
+    ecs.reserve<Guest>(GuestPartySize);
+
+    // Guests leave behind empty hierarchy tables, delete tables that have been
+    // empty for 10 seconds. Spend at most half a millisecond per frame on it.
+    // Tables that used less than a quarter of their storage for 10 seconds are
+    // shrunk.
+    ecs.set_empty_table_gc(600, 600, 0.0005);
+
     // Run the app
     return ecs.app()
         .target_fps(60)